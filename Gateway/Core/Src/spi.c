@@ -21,7 +21,31 @@
 #include "spi.h"
 
 /* USER CODE BEGIN 0 */
+DMA_HandleTypeDef hdma_spi1_rx;
+DMA_HandleTypeDef hdma_spi1_tx;
+DMA_HandleTypeDef hdma_spi4_rx;
+DMA_HandleTypeDef hdma_spi4_tx;
 
+/**
+ * Configure one normal mode, byte wide DMA stream for a SPI direction.
+ */
+static void SPI_DMA_Stream_Init(DMA_HandleTypeDef *hdma, DMA_Stream_TypeDef *stream, uint32_t request, uint32_t direction)
+{
+  hdma->Instance = stream;
+  hdma->Init.Request = request;
+  hdma->Init.Direction = direction;
+  hdma->Init.PeriphInc = DMA_PINC_DISABLE;
+  hdma->Init.MemInc = DMA_MINC_ENABLE;
+  hdma->Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
+  hdma->Init.MemDataAlignment = DMA_MDATAALIGN_BYTE;
+  hdma->Init.Mode = DMA_NORMAL;
+  hdma->Init.Priority = DMA_PRIORITY_HIGH;
+  hdma->Init.FIFOMode = DMA_FIFOMODE_DISABLE;
+  if (HAL_DMA_Init(hdma) != HAL_OK)
+  {
+    Error_Handler();
+  }
+}
 /* USER CODE END 0 */
 
 SPI_HandleTypeDef hspi1;
@@ -157,7 +181,23 @@ void HAL_SPI_MspInit(SPI_HandleTypeDef* spiHandle)
     HAL_GPIO_Init(GPIOB, &GPIO_InitStruct);
 
   /* USER CODE BEGIN SPI1_MspInit 1 */
+    /* SPI1 DMA Init */
+    __HAL_RCC_DMA1_CLK_ENABLE();
 
+    SPI_DMA_Stream_Init(&hdma_spi1_rx, DMA1_Stream0, DMA_REQUEST_SPI1_RX, DMA_PERIPH_TO_MEMORY);
+    __HAL_LINKDMA(spiHandle,hdmarx,hdma_spi1_rx);
+
+    SPI_DMA_Stream_Init(&hdma_spi1_tx, DMA1_Stream1, DMA_REQUEST_SPI1_TX, DMA_MEMORY_TO_PERIPH);
+    __HAL_LINKDMA(spiHandle,hdmatx,hdma_spi1_tx);
+
+    HAL_NVIC_SetPriority(DMA1_Stream0_IRQn, 5, 0);
+    HAL_NVIC_EnableIRQ(DMA1_Stream0_IRQn);
+    HAL_NVIC_SetPriority(DMA1_Stream1_IRQn, 5, 0);
+    HAL_NVIC_EnableIRQ(DMA1_Stream1_IRQn);
+
+    /* SPI1 interrupt Init */
+    HAL_NVIC_SetPriority(SPI1_IRQn, 5, 0);
+    HAL_NVIC_EnableIRQ(SPI1_IRQn);
   /* USER CODE END SPI1_MspInit 1 */
   }
   else if(spiHandle->Instance==SPI4)
@@ -192,7 +232,23 @@ void HAL_SPI_MspInit(SPI_HandleTypeDef* spiHandle)
     HAL_GPIO_Init(GPIOE, &GPIO_InitStruct);
 
   /* USER CODE BEGIN SPI4_MspInit 1 */
+    /* SPI4 DMA Init */
+    __HAL_RCC_DMA1_CLK_ENABLE();
+
+    SPI_DMA_Stream_Init(&hdma_spi4_rx, DMA1_Stream2, DMA_REQUEST_SPI4_RX, DMA_PERIPH_TO_MEMORY);
+    __HAL_LINKDMA(spiHandle,hdmarx,hdma_spi4_rx);
+
+    SPI_DMA_Stream_Init(&hdma_spi4_tx, DMA1_Stream3, DMA_REQUEST_SPI4_TX, DMA_MEMORY_TO_PERIPH);
+    __HAL_LINKDMA(spiHandle,hdmatx,hdma_spi4_tx);
+
+    HAL_NVIC_SetPriority(DMA1_Stream2_IRQn, 5, 0);
+    HAL_NVIC_EnableIRQ(DMA1_Stream2_IRQn);
+    HAL_NVIC_SetPriority(DMA1_Stream3_IRQn, 5, 0);
+    HAL_NVIC_EnableIRQ(DMA1_Stream3_IRQn);
 
+    /* SPI4 interrupt Init */
+    HAL_NVIC_SetPriority(SPI4_IRQn, 5, 0);
+    HAL_NVIC_EnableIRQ(SPI4_IRQn);
   /* USER CODE END SPI4_MspInit 1 */
   }
 }
@@ -218,7 +274,12 @@ void HAL_SPI_MspDeInit(SPI_HandleTypeDef* spiHandle)
     HAL_GPIO_DeInit(GPIOB, GPIO_PIN_3|GPIO_PIN_4);
 
   /* USER CODE BEGIN SPI1_MspDeInit 1 */
+    /* SPI1 DMA DeInit */
+    HAL_DMA_DeInit(spiHandle->hdmarx);
+    HAL_DMA_DeInit(spiHandle->hdmatx);
 
+    /* SPI1 interrupt Deinit */
+    HAL_NVIC_DisableIRQ(SPI1_IRQn);
   /* USER CODE END SPI1_MspDeInit 1 */
   }
   else if(spiHandle->Instance==SPI4)
@@ -237,7 +298,12 @@ void HAL_SPI_MspDeInit(SPI_HandleTypeDef* spiHandle)
     HAL_GPIO_DeInit(GPIOE, GPIO_PIN_12|GPIO_PIN_13|GPIO_PIN_14);
 
   /* USER CODE BEGIN SPI4_MspDeInit 1 */
+    /* SPI4 DMA DeInit */
+    HAL_DMA_DeInit(spiHandle->hdmarx);
+    HAL_DMA_DeInit(spiHandle->hdmatx);
 
+    /* SPI4 interrupt Deinit */
+    HAL_NVIC_DisableIRQ(SPI4_IRQn);
   /* USER CODE END SPI4_MspDeInit 1 */
   }
 }
@@ -62,6 +62,13 @@ extern ETH_HandleTypeDef heth;
 static const char *Excep_TAG = "EXCEPTION";
 static const char *Inter_TAG = "INTERRUPT";
 extern void LOG_ERROR(const char *tag, const char *format, ...);
+extern SPI_HandleTypeDef hspi1;
+extern SPI_HandleTypeDef hspi4;
+extern DMA_HandleTypeDef hdma_spi1_rx;
+extern DMA_HandleTypeDef hdma_spi1_tx;
+extern DMA_HandleTypeDef hdma_spi4_rx;
+extern DMA_HandleTypeDef hdma_spi4_tx;
+extern TIM_HandleTypeDef htim2;
 /* USER CODE END EV */
 
 /******************************************************************************/
@@ -275,5 +282,59 @@ void ETH_IRQHandler(void)
 }
 
 /* USER CODE BEGIN 1 */
+/**
+  * @brief This function handles DMA1 stream0 global interrupt (SPI1 RX).
+  */
+void DMA1_Stream0_IRQHandler(void)
+{
+  HAL_DMA_IRQHandler(&hdma_spi1_rx);
+}
+
+/**
+  * @brief This function handles DMA1 stream1 global interrupt (SPI1 TX).
+  */
+void DMA1_Stream1_IRQHandler(void)
+{
+  HAL_DMA_IRQHandler(&hdma_spi1_tx);
+}
 
+/**
+  * @brief This function handles DMA1 stream2 global interrupt (SPI4 RX).
+  */
+void DMA1_Stream2_IRQHandler(void)
+{
+  HAL_DMA_IRQHandler(&hdma_spi4_rx);
+}
+
+/**
+  * @brief This function handles DMA1 stream3 global interrupt (SPI4 TX).
+  */
+void DMA1_Stream3_IRQHandler(void)
+{
+  HAL_DMA_IRQHandler(&hdma_spi4_tx);
+}
+
+/**
+  * @brief This function handles SPI1 global interrupt.
+  */
+void SPI1_IRQHandler(void)
+{
+  HAL_SPI_IRQHandler(&hspi1);
+}
+
+/**
+  * @brief This function handles SPI4 global interrupt.
+  */
+void SPI4_IRQHandler(void)
+{
+  HAL_SPI_IRQHandler(&hspi4);
+}
+
+/**
+  * @brief This function handles TIM2 global interrupt.
+  */
+void TIM2_IRQHandler(void)
+{
+  HAL_TIM_IRQHandler(&htim2);
+}
 /* USER CODE END 1 */
@@ -9,14 +9,17 @@
 #include "task.h"
 #include "queue.h"
 #include "semphr.h"
+#include "timers.h"
 
 #include "log/log.h"
 #include "sysinfo/sysinfo.h"
 
 #include "lorawan/lrphys/lrphys.h"
 #include "lorawan/lrmac/lrmac.h"
+#include "lorawan/lrmac/lrmac_duty.h"
+#include "lorawan/lrmac/lrmac_timer.h"
 #include "lorawan/gateway/gateway.h"
-#include "lorawan/base64/base64.h"
+#include "lorawan/gateway/gateway_downlink.h"
 
 #include "lwipopts.h"
 #include "lwip/sockets.h"
@@ -25,56 +28,82 @@
 #include "lwip/apps/sntp_opts.h"
 #include "lwip/apps/sntp.h"
 
+#include "tim.h"
 
 
 
 
+
+/**
+ * Time a radio is taken by one downlink, from the scheduler wake until TX
+ * done. Kept after the downlink went on air (owner NULL) until end passes.
+ */
 typedef struct{
+	bool                 used = false;
+	lrwgw_downlink_t      *owner = NULL;
 	uint8_t              channel = 0;
-	bool 				 immediately = false;
-	uint32_t             timestamp = 0;
-	uint32_t 			 txdelay = 0;
-	lrmac_phys_setting_t *setting;
-	lrmac_packet_t       *packet;
-} schedule_item_t;
+	uint32_t             start = 0;
+	uint32_t             end = 0;
+} tx_window_t;
+
+/**
+ * Reactor events, bits of the reactor task notification value.
+ */
+#define LRWGW_EVENT_RX        LRMAC_NOTIFY_PACKET /** Frames in the lrmac rings */
+#define LRWGW_EVENT_TXPK      (1UL << 1)          /** PULL_RESP queued */
+#define LRWGW_EVENT_KEEPALIVE (1UL << 2)
+#define LRWGW_EVENT_STAT      (1UL << 3)
+#define LRWGW_EVENT_STOP      (1UL << 4)          /** Leave at the top of the loop */
 
 static const char *TAG = "LoRaWAN";
 
-static QueueHandle_t queue_rxpkt;
-static QueueHandle_t queue_txpkt;
-static QueueHandle_t queue_sched;
+static QueueHandle_t queue_txpkt = NULL;
+static tx_window_t tx_window[LRWGW_SCHED_SIZE + LRWGW_PHYS_MAX];
 
-static TaskHandle_t htask_forward_uplink = NULL;
-static TaskHandle_t htask_handle_downlink = NULL;
-static TaskHandle_t htask_keepalive = NULL;
-static TaskHandle_t htask_send_status = NULL;
+static TaskHandle_t htask_reactor = NULL;
 static TaskHandle_t htask_schedule_downlink = NULL;
+static TimerHandle_t htimer_keepalive = NULL;
+static TimerHandle_t htimer_send_status = NULL;
+static SemaphoreHandle_t sem_task_exit = NULL;
+static bool gateway_stopping = false;
+static lorawan_gateway_stats_t gateway_stats;
 
 
 /**
  * Function prototype.
  */
-static void lrwgw_handle_rxpkt(lorawan_gateway_t *pgtw);
-static void lrwgw_handle_txpkt(lorawan_gateway_t *pgtw);
+static bool lrwgw_handle_rxpkt(lorawan_gateway_t *pgtw);
+static bool lrwgw_handle_txpkt(lorawan_gateway_t *pgtw);
+static bool lrwgw_transmit(lrwgw_downlink_t *item);
+static void lrwgw_release_downlink(lrwgw_downlink_t *item, bool refund);
+static uint32_t lrwgw_wake_lead_us(void);
+static udpsem_txpk_ack_error_t lrwgw_admit(udpsem_txpk_t *txpkt, uint8_t *channel, uint32_t airtime_us, uint32_t *tmst);
+static bool lrwgw_window_collides(uint8_t channel, uint32_t start, uint32_t end);
+static bool lrwgw_window_reserve(lrwgw_downlink_t *item);
+static void lrwgw_window_release(lrwgw_downlink_t *item, bool on_air);
 
 static void lrwgw_udpsemtech_event_handler(udpsem_t *phander, udpsem_event_t event, void *param);
 
-static void lrwgw_task_forward_uplink(void *pgtw);
-static void lrwgw_task_handle_downlink(void *pgtw);
+static void lrwgw_notify(uint32_t event);
+static void lrwgw_timer_callback(TimerHandle_t timer);
+
+static void lrwgw_task_reactor(void *pgtw);
 static void lrwgw_task_schedule_downlink(void *pgtw);
-static void lrwgw_task_keepalive(void *pgtw);
-static void lrwgw_task_send_status(void *pgtw);
+static void lrwgw_task_exit(TaskHandle_t *ptask);
 
 
 /**
  * Function declaration.
  */
 void lorawan_gateway_initialize(lorawan_gateway_t *pgtw){
-	queue_rxpkt = xQueueCreate(LRWGW_PHYS_RXPKT_QUEUE_SIZE, sizeof(uint32_t));
-	queue_txpkt = xQueueCreate(LRWGW_PHYS_TXPKT_QUEUE_SIZE, sizeof(uint32_t));
-	queue_sched = xQueueCreate(LRWGW_PHYS_TXPKT_QUEUE_SIZE, sizeof(schedule_item_t *));
+	queue_txpkt = xQueueCreate(LRWGW_PHYS_TXPKT_QUEUE_SIZE, sizeof(lrwgw_downlink_t *));
+	sem_task_exit = xSemaphoreCreateCounting(2, 0);
+	lrwgw_downlink_initialize();
 
-	lrmac_initialize(&queue_rxpkt);
+	lrmac_initialize(&htask_reactor);
+	lrmac_register_tx_listener(&htask_schedule_downlink);
+	if(!lrmac_timer_initialize(&htim2, LRWGW_SCHED_TIM_CHANNEL, &htask_schedule_downlink))
+		LOG_ERROR(TAG, "Fail to set up the downlink timer");
 
 	udpsem_initialize(&pgtw->udpsemtech, &pgtw->server_info, &pgtw->gateway_info, &queue_txpkt);
 	udpsem_register_event_handler(&pgtw->udpsemtech, lrwgw_udpsemtech_event_handler, NULL);
@@ -102,6 +131,10 @@ void lorawan_gateway_set_coordinate(lorawan_gateway_t *pgtw, float latitude, flo
 
 
 err_t lorawan_gateway_start(lorawan_gateway_t *pgtw){
+	/** Gone after a stop, the UDP callback queues into it once connected */
+	if(queue_txpkt == NULL)
+		queue_txpkt = xQueueCreate(LRWGW_PHYS_TXPKT_QUEUE_SIZE, sizeof(lrwgw_downlink_t *));
+
 	err_t ret = udpsem_connect(&pgtw->udpsemtech);
 	if(ret != ERR_OK) return ret;
 
@@ -110,203 +143,257 @@ err_t lorawan_gateway_start(lorawan_gateway_t *pgtw){
 
 	udpsem_keepalive(&pgtw->udpsemtech);
 
-	if(htask_send_status != NULL)       vTaskResume(htask_send_status);
-	else xTaskCreate(lrwgw_task_send_status,       "lrwgw_task_send_status",      4096/4,  (void *)pgtw, 4,  &htask_send_status);
-
-	if(htask_keepalive   != NULL)       vTaskResume(htask_keepalive);
-	else xTaskCreate(lrwgw_task_keepalive,         "lrwgw_task_keepalive",        4096/4,  (void *)pgtw, 2,  &htask_keepalive);
-
-	if(htask_forward_uplink != NULL)    vTaskResume(htask_forward_uplink);
-	else xTaskCreate(lrwgw_task_forward_uplink,    "lrwgw_task_forward_uplink",   10240/4, (void *)pgtw, 6,  &htask_forward_uplink);
-
-	if(htask_handle_downlink != NULL)   vTaskResume(htask_handle_downlink);
-	else xTaskCreate(lrwgw_task_handle_downlink,   "lrwgw_task_handle_downlink",  20480/4, (void *)pgtw, 10, &htask_handle_downlink);
-
-	if(htask_schedule_downlink != NULL) vTaskResume(htask_schedule_downlink);
-	else xTaskCreate(lrwgw_task_schedule_downlink, "lrwgw_task_forward_downlink", 4096/4,  (void *)pgtw, 8,  &htask_schedule_downlink);
+	__atomic_store_n(&gateway_stopping, false, __ATOMIC_RELEASE);
+	if(htask_reactor == NULL)
+		xTaskCreate(lrwgw_task_reactor,           "lrwgw_task_reactor",          LRWGW_REACTOR_STACK_SIZE/4, (void *)pgtw, 10, &htask_reactor);
+	if(htask_schedule_downlink == NULL)
+		xTaskCreate(lrwgw_task_schedule_downlink, "lrwgw_task_forward_downlink", LRWGW_SCHED_STACK_SIZE/4,   (void *)pgtw, 11, &htask_schedule_downlink);
+
+	/**
+	 * Keep alive and status only raise reactor events, from the timer service task.
+	 */
+	if(htimer_keepalive == NULL)
+		htimer_keepalive   = xTimerCreate("lrwgw_keepalive", pdMS_TO_TICKS(pgtw->keepalive_interval * 1000UL), pdTRUE, (void *)LRWGW_EVENT_KEEPALIVE, lrwgw_timer_callback);
+	if(htimer_send_status == NULL)
+		htimer_send_status = xTimerCreate("lrwgw_send_status", pdMS_TO_TICKS(pgtw->stat_interval * 1000UL), pdTRUE, (void *)LRWGW_EVENT_STAT, lrwgw_timer_callback);
+
+	if(htimer_keepalive == NULL || htimer_send_status == NULL){
+		LOG_ERROR(TAG, "Fail to create the gateway timers");
+		return ERR_MEM;
+	}
+	xTimerChangePeriod(htimer_keepalive,   pdMS_TO_TICKS(pgtw->keepalive_interval * 1000UL), 10);
+	xTimerChangePeriod(htimer_send_status, pdMS_TO_TICKS(pgtw->stat_interval * 1000UL), 10);
 
 	return ret;
 }
 
+/**
+ * The reactor and the scheduler are asked to leave and left to do so at the
+ * top of their loop, never while they hold a radio lock or wait for a tmst.
+ * Their handles are NULL once they are gone, so is the queue once deleted.
+ */
 void lorawan_gateway_stop(lorawan_gateway_t *pgtw){
-	if(htask_send_status != NULL)       vTaskSuspend(htask_send_status);
-	if(htask_keepalive != NULL) 		vTaskSuspend(htask_keepalive);
-	if(htask_forward_uplink != NULL) 	vTaskSuspend(htask_forward_uplink);
-	if(htask_handle_downlink != NULL)   vTaskSuspend(htask_handle_downlink);
-	if(htask_schedule_downlink != NULL) vTaskSuspend(htask_schedule_downlink);
+	uint8_t running = 0;
+
+	if(htimer_keepalive != NULL)        xTimerStop(htimer_keepalive, 10);
+	if(htimer_send_status != NULL)      xTimerStop(htimer_send_status, 10);
 
 	udpsem_disconnect(&pgtw->udpsemtech);
 
-	if(pgtw->event_handler)
-		pgtw->event_handler(pgtw, LORAWAN_GATEWAY_DISCONNECT, pgtw->event_parameter);
+	__atomic_store_n(&gateway_stopping, true, __ATOMIC_RELEASE);
+	taskENTER_CRITICAL();
+	if(htask_reactor != NULL){
+		xTaskNotify(htask_reactor, LRWGW_EVENT_STOP, eSetBits);
+		running++;
+	}
+	if(htask_schedule_downlink != NULL){
+		xTaskNotifyGive(htask_schedule_downlink);
+		running++;
+	}
+	taskEXIT_CRITICAL();
 
-	if(queue_rxpkt != NULL) vQueueDelete(queue_rxpkt);
-	if(queue_txpkt != NULL) vQueueDelete(queue_txpkt);
-	if(queue_sched != NULL) vQueueDelete(queue_sched);
-}
+	while(running > 0 && xSemaphoreTake(sem_task_exit, pdMS_TO_TICKS(LRWGW_STOP_TIMEOUT_MS)) == pdTRUE)
+		running--;
+	if(running > 0){
+		LOG_ERROR(TAG, "Gateway task did not stop, queue and schedule kept");
+		return;
+	}
 
+	if(pgtw->event_handler)
+		pgtw->event_handler(pgtw, LORAWAN_GATEWAY_DISCONNECT, pgtw->event_parameter);
 
+	/**
+	 * Downlinks still queued or pending will never make their window now.
+	 */
+	lrwgw_downlink_t *item = NULL;
+	while(queue_txpkt != NULL && xQueueReceive(queue_txpkt, &item, 0) == pdTRUE)
+		lrwgw_downlink_free(item);
+	while((item = (lrwgw_downlink_t *)lrmac_timer_pop()) != NULL)
+		lrwgw_release_downlink(item, true);
 
+	if(queue_txpkt != NULL){
+		QueueHandle_t queue = queue_txpkt;
 
-static void lrwgw_handle_rxpkt(lorawan_gateway_t *pgtw){
-	lrmac_packet_t *macpkt;
+		queue_txpkt = NULL;
+		vQueueDelete(queue);
+	}
+}
 
-	if(xQueueReceive(queue_rxpkt, (void *)&macpkt, 10) == pdTRUE){
-		if(macpkt != NULL){
-			/** Increment rx packet counter */
-			switch(macpkt->eventid){
-				case LRPHYS_TRANSMIT_COMPLETED:
-					pgtw->udpsemtech.rxfw++;
-				break;
-				case LRPHYS_RECEIVE_COMPLETED:
-					pgtw->udpsemtech.rxnb++;
-					pgtw->udpsemtech.rxok++;
-				break;
-				case LRPHYS_ERROR_CRC:
-					pgtw->udpsemtech.rxnb++;
-					if(macpkt != NULL) free((lrmac_packet_t *)macpkt);
-					return;
-				break;
-			}
+void lorawan_gateway_get_stats(lorawan_gateway_stats_t *stats){
+	*stats = gateway_stats;
+	stats->stack_free_min       = (htask_reactor != NULL)? uxTaskGetStackHighWaterMark(htask_reactor) * sizeof(StackType_t) : 0;
+	stats->sched_stack_free_min = (htask_schedule_downlink != NULL)? uxTaskGetStackHighWaterMark(htask_schedule_downlink) * sizeof(StackType_t) : 0;
+}
 
-			/** Send rx packet to server */
-			if(macpkt->payload != NULL){
-				udpsem_rxpk_t rxpkt;
-				lrmac_phys_info_t phys_info;
+void lorawan_gateway_reset_stats(void){
+	memset((void *)&gateway_stats, 0, sizeof(lorawan_gateway_stats_t));
+}
 
-				lrmac_get_phys_info(macpkt->channel, &phys_info);
 
-				rxpkt.channel  = macpkt->channel;
-				rxpkt.rf_chain = 0;
-				rxpkt.freq     = (float)(phys_info.freq / 1000000.0);
-				rxpkt.crc_stat = 1;
-				rxpkt.sf       = phys_info.sf;
-				rxpkt.bw       = (phys_info.bw / 1000);
-				rxpkt.codr 	   = phys_info.cdr;
-				rxpkt.rssi 	   = phys_info.rssi;
-				rxpkt.snr      = phys_info.snr;
-				rxpkt.data     = (uint8_t *)macpkt->payload;
-				rxpkt.size     = macpkt->payload_size;
 
-				udpsem_push_data(&pgtw->udpsemtech, &rxpkt, 0);
 
-				if(macpkt->payload != NULL) free(macpkt->payload);
-			}
+/**
+ * Forward one frame from the lrmac rings, false when they are drained.
+ */
+static bool lrwgw_handle_rxpkt(lorawan_gateway_t *pgtw){
+	lrmac_packet_t *macpkt = lrmac_next_packet();
 
-			if(pgtw->event_handler)
-				pgtw->event_handler(pgtw, (lorawan_gateway_event_t)(macpkt->eventid + 2), pgtw->event_parameter);
+	if(macpkt == NULL) return false;
 
-			if(macpkt != NULL) free((lrmac_packet_t *)macpkt);
-		}
-		else{
-			LOG_ERROR(TAG, "NULL packet from MAC");
-		}
+	/** Increment rx packet counter */
+	switch(macpkt->eventid){
+		case LRPHYS_TRANSMIT_COMPLETED:
+			pgtw->udpsemtech.rxfw++;
+		break;
+		case LRPHYS_RECEIVE_COMPLETED:
+			pgtw->udpsemtech.rxnb++;
+			pgtw->udpsemtech.rxok++;
+		break;
+		case LRPHYS_ERROR_CRC:
+			pgtw->udpsemtech.rxnb++;
+			lrmac_release_packet(macpkt);
+			return true;
+		break;
 	}
-}
 
-static void lrwgw_handle_txpkt(lorawan_gateway_t *pgtw){
-	uint8_t *downlink_pkt = NULL;
+	/** Send rx packet to server */
+	if(macpkt->payload != NULL){
+		udpsem_rxpk_t rxpkt;
+		lrphys_rx_meta_t *meta = &macpkt->meta;
 
-	if(xQueueReceive(queue_txpkt, &downlink_pkt, 10) == pdTRUE){
-		udpsem_txpk_t *txpkt = NULL;
-		udpsem_txpk_ack_error_t ack_error = UDPSEM_ERROR_NONE;
-		uint8_t channel = 0;
-		uint32_t gps_time = 0;
-
-		if(downlink_pkt == NULL){
-			LOG_ERROR(TAG, "NULL pointer at %s -> %d", __FUNCTION__, __LINE__);
-			return;
-		}
-
-		txpkt = (udpsem_txpk_t *)malloc(sizeof(udpsem_txpk_t));
-		if(txpkt == NULL){
-    		LOG_ERROR(TAG, "Memory exhausted, malloc fail at %s -> %d", __FUNCTION__, __LINE__);
-    		if(downlink_pkt != NULL) free(downlink_pkt);
-    		return;
-		}
+		/**
+		 * Everything below was captured at RxDone, no radio access here.
+		 */
+		rxpkt.channel  = macpkt->channel;
+		rxpkt.rf_chain = 0;
+		rxpkt.freq     = meta->freq;
+		rxpkt.crc_stat = 1;
+		rxpkt.sf       = meta->sf;
+		rxpkt.bw       = meta->bw;
+		rxpkt.codr 	   = meta->cr;
+		rxpkt.rssi 	   = meta->rssi;
+		rxpkt.snr      = meta->snr;
+		rxpkt.foff     = meta->freq_error;
+		rxpkt.data     = (uint8_t *)macpkt->payload;
+		rxpkt.size     = macpkt->payload_size;
+		rxpkt.tmst     = meta->tmst;
+
+		udpsem_push_rxpk(&pgtw->udpsemtech, &rxpkt);
+	}
 
-		char *jsondata = (char *)(downlink_pkt + 4U);
-		if(udpsem_parse_pull_resp(jsondata, txpkt) == false){
-    		LOG_ERROR(TAG, "Json format error at %s -> %d", __FUNCTION__, __LINE__);
-			if(txpkt->modu != NULL)  free(txpkt->modu);
-			if(txpkt->data != NULL)  free(txpkt->data);
-			if(downlink_pkt != NULL) free(downlink_pkt);
-			if(txpkt != NULL)        free(txpkt);
-    		return;
-		}
+	if(pgtw->event_handler)
+		pgtw->event_handler(pgtw, (lorawan_gateway_event_t)(macpkt->eventid + 2), pgtw->event_parameter);
 
+	lrmac_release_packet(macpkt);
 
-		gps_time  = udpsem_get_time_stamp();
-		ack_error = udpsem_check_error(txpkt, gps_time);
-		channel   = lrmac_get_channel_by_freq((long)(txpkt->freq * 1E6));
+	return true;
+}
 
+/**
+ * Admit one queued PULL_RESP, false when none is waiting.
+ */
+static bool lrwgw_handle_txpkt(lorawan_gateway_t *pgtw){
+	lrwgw_downlink_t *downlink = NULL;
+
+	if(xQueueReceive(queue_txpkt, &downlink, 0) != pdTRUE) return false;
+
+	udpsem_txpk_t txpk;
+	udpsem_txpk_t *txpkt = &txpk;
+	udpsem_txpk_ack_error_t ack_error = UDPSEM_ERROR_NONE;
+	uint8_t channel = 0;
+	uint32_t gps_time = 0;
+	uint32_t airtime_us = 0;
+	uint32_t tmst = 0;
+	uint16_t token = 0;
+	long freq = 0;
+
+	if(downlink == NULL){
+		LOG_ERROR(TAG, "NULL pointer at %s -> %d", __FUNCTION__, __LINE__);
+		return true;
+	}
+	token = downlink->token;
+
+	/**
+	 * The payload decodes over the JSON text of the same descriptor.
+	 */
+	if(udpsem_parse_pull_resp(downlink->json, txpkt, downlink->data, sizeof(downlink->data)) == false){
+		LOG_ERROR(TAG, "Json format error at %s -> %d", __FUNCTION__, __LINE__);
+		lrwgw_downlink_free(downlink);
+		return true;
+	}
 
-		LOG_INFO(TAG, "Time tmst       : %lu",     txpkt->tmst);
-		LOG_INFO(TAG, "Channel         : %d",      channel);
-		LOG_INFO(TAG, "Modulation      : %s",      txpkt->modu);
-		LOG_INFO(TAG, "Frequency       : %.1fMHz", txpkt->freq);
-		LOG_INFO(TAG, "Spreading Factor: %d",      txpkt->sf);
-		LOG_INFO(TAG, "Band Width      : %dKHz",   txpkt->bw);
-		LOG_INFO(TAG, "Coding Rate     : 4/%d",    txpkt->codr);
-		LOG_INFO(TAG, "Preamble length : %d",      txpkt->prea);
-		LOG_INFO(TAG, "Power           : %d",      txpkt->powe);
 
-		if(ack_error != UDPSEM_ERROR_TX_FREQ && ack_error != UDPSEM_ERROR_TX_POWER){
-			lrmac_phys_setting_t *phys_setting  = (lrmac_phys_setting_t *)malloc(sizeof(lrmac_phys_setting_t));
-			lrmac_packet_t       *sendpacket    = (lrmac_packet_t *)malloc(sizeof(lrmac_packet_t));
-			schedule_item_t      *schedule_item = (schedule_item_t *)malloc(sizeof(schedule_item_t));
+	gps_time  = udpsem_get_time_stamp();
+	ack_error = udpsem_check_error(txpkt, gps_time);
+	freq      = lrmac_region_freq_hz(txpkt->freq);
+	channel   = lrmac_get_tx_channel(freq);
+	airtime_us = lrphys_airtime_us(txpkt->size, txpkt->sf, txpkt->bw * 1000U, txpkt->codr, txpkt->prea, !txpkt->ncrc);
+	if(channel == LRMAC_CHANNEL_NONE && ack_error == UDPSEM_ERROR_NONE)
+		ack_error = UDPSEM_ERROR_TX_FREQ;
+	if(ack_error == UDPSEM_ERROR_NONE)
+		ack_error = lrwgw_admit(txpkt, &channel, airtime_us, &tmst);
+
+	/**
+	 * Refused here the server can still reroute, a sub-band out of duty cycle
+	 * to another frequency. The ledger is charged last, only for downlinks
+	 * that go on. Listen before talk is left to TX time, lrmac_send_packet(),
+	 * the channel now says nothing about the channel in the RX window.
+	 */
+	if(ack_error == UDPSEM_ERROR_NONE && !lrmac_duty_reserve(freq, airtime_us))
+		ack_error = UDPSEM_ERROR_TX_FREQ;
+
+
+	LOG_INFO(TAG, "Time tmst       : %lu",     txpkt->tmst);
+	LOG_INFO(TAG, "Channel         : %d",      channel);
+	LOG_INFO(TAG, "Modulation      : %s",      txpkt->modu);
+	LOG_INFO(TAG, "Frequency       : %.1fMHz", txpkt->freq);
+	LOG_INFO(TAG, "Spreading Factor: %d",      txpkt->sf);
+	LOG_INFO(TAG, "Band Width      : %dKHz",   txpkt->bw);
+	LOG_INFO(TAG, "Coding Rate     : 4/%d",    txpkt->codr);
+	LOG_INFO(TAG, "Preamble length : %d",      txpkt->prea);
+	LOG_INFO(TAG, "Power           : %d",      txpkt->powe);
+	LOG_INFO(TAG, "Time on air     : %luus",   airtime_us);
+
+	if(ack_error == UDPSEM_ERROR_NONE){
+		downlink->setting.freq = freq;
+		downlink->setting.powe = txpkt->powe;
+		downlink->setting.sf   = txpkt->sf;
+		downlink->setting.bw   = txpkt->bw * 1000U; /** kHz in the txpk datr */
+		downlink->setting.codr = txpkt->codr;
+		downlink->setting.prea = txpkt->prea;
+		downlink->setting.crc  = !txpkt->ncrc;
+		downlink->setting.iiq  = txpkt->ipol;
+
+		downlink->packet.channel      = channel;
+		downlink->packet.meta.tmst    = tmst;
+		downlink->packet.payload_size = txpkt->size;
+
+		downlink->channel     = channel;
+		downlink->immediately = txpkt->imme;
+		downlink->tmst        = tmst;
+		downlink->airtime_us  = airtime_us;
 
-			if(phys_setting == NULL || sendpacket == NULL || schedule_item == NULL){
-	    		LOG_ERROR(TAG, "Memory exhausted, malloc fail at %s -> %d", __FUNCTION__, __LINE__);
-	    		if(downlink_pkt != NULL) free(downlink_pkt);
-	    		if(txpkt != NULL) free(txpkt);
-	    		return;
-			}
+		/**
+		 * The scheduler wakes LRWGW_SCHED_LEAD_US (plus the LBT listen time)
+		 * ahead, retunes, loads the FIFO, then starts TX on tmst itself.
+		 */
+		uint32_t wake = (txpkt->imme)? tmst : tmst - lrwgw_wake_lead_us();
 
-			phys_setting->freq = (long)(txpkt->freq * 1E6);
-			phys_setting->powe = txpkt->powe;
-			phys_setting->sf   = txpkt->sf;
-			phys_setting->bw   = txpkt->bw;
-			phys_setting->codr = txpkt->codr;
-			phys_setting->prea = txpkt->prea;
-			phys_setting->crc  = txpkt->ncrc;
-			phys_setting->iiq  = txpkt->ipol;
-
-			sendpacket->channel = channel;
-			sendpacket->payload = (uint8_t *)malloc(400);
-			memset(sendpacket->payload, 0, 400);
-			sendpacket->payload_size = b64_to_bin((const char *)txpkt->data, strlen((const char *)txpkt->data), sendpacket->payload, txpkt->size);
-
-			schedule_item->channel     = channel;
-			schedule_item->immediately = txpkt->imme;
-			schedule_item->timestamp   = pgtw->udpsemtech.time_stamp;
-			schedule_item->txdelay     = txpkt->tmst - pgtw->udpsemtech.time_stamp;
-			schedule_item->packet      = sendpacket;
-			schedule_item->setting     = phys_setting;
-
-			if(xQueueSend(queue_sched, (void *)&schedule_item, 10) == pdFALSE){
-				LOG_ERROR(TAG, "Error queue full at %s -> %d", __FUNCTION__, __LINE__);
-
-				if(sendpacket->payload != NULL) free(sendpacket->payload);
-				if(sendpacket != NULL)          free(sendpacket);
-				if(phys_setting != NULL)        free(phys_setting);
-				if(schedule_item != NULL)       free(schedule_item);
-
-				if(txpkt->modu != NULL)  free(txpkt->modu);
-				if(txpkt->data != NULL)  free(txpkt->data);
-				if(downlink_pkt != NULL) free(downlink_pkt);
-				if(txpkt != NULL)        free(txpkt);
-
-				return;
-			}
+		/**
+		 * A full schedule is answered like the packet forwarder's JIT queue does.
+		 */
+		if(!lrwgw_window_reserve(downlink) || !lrmac_timer_schedule(wake, downlink)){
+			LOG_ERROR(TAG, "Error schedule full at %s -> %d", __FUNCTION__, __LINE__);
+			lrwgw_release_downlink(downlink, true);
+			ack_error = UDPSEM_ERROR_COLLISION_PACKET;
 		}
-
-		udpsem_send_tx_ack(&pgtw->udpsemtech, ack_error);
-		if(txpkt->modu != NULL)  free(txpkt->modu);
-		if(txpkt->data != NULL)  free(txpkt->data);
-		if(txpkt != NULL)        free(txpkt);
-		if(downlink_pkt != NULL) free(downlink_pkt);
+		downlink = NULL; /** Owned by the scheduler from here, or released */
 	}
+
+	udpsem_send_tx_ack(&pgtw->udpsemtech, token, ack_error);
+	if(downlink != NULL) lrwgw_downlink_free(downlink);
+
+	return true;
 }
 
 
@@ -322,6 +409,7 @@ static void lrwgw_udpsemtech_event_handler(udpsem_t *pudp, udpsem_event_t event,
 		break;
 		case UDPSEM_EVENTID_RECV_DATA:
 			LOG_EVENT(TAG, "Received downlink message, token = %d", event.token);
+			lrwgw_notify(LRWGW_EVENT_TXPK);
 		break;
 		case UDPSEM_EVENTID_KEEPALIVE:
 			LOG_EVENT(TAG, "Keep alive connection, free heap = %lubytes", dev_get_free_heap_size());
@@ -337,32 +425,45 @@ static void lrwgw_udpsemtech_event_handler(udpsem_t *pudp, udpsem_event_t event,
 
 
 /**
- * Gateway task: lrwgw_task_forward_uplink.
- * To Do: Forward uplink message from end device to server.
+ * Gateway task: lrwgw_task_reactor.
+ * To Do: Forward uplinks, admit downlinks, keep alive and send status, each
+ * raised as a notification bit, and sleep in between.
  */
-static void lrwgw_task_forward_uplink(void *pgtw){
+static void lrwgw_task_reactor(void *pgtw){
 	lorawan_gateway_t *gateway = (lorawan_gateway_t *)pgtw;
+	uint32_t events = 0;
 
 	while(1){
 		/**
-		 * Process the rxpk form lora MAC.
+		 * Sleep until an event, or until the pending PUSH_DATA is due.
 		 */
-		lrwgw_handle_rxpkt(gateway);
-	}
-}
+		events = 0;
+		if(xTaskNotifyWait(0, 0xFFFFFFFFUL, &events, udpsem_push_poll(&gateway->udpsemtech)) == pdFALSE)
+			gateway_stats.timeouts++;
+		gateway_stats.wakeups++;
 
-/**
- * Gateway task: lrwgw_task_forward_downlink.
- * To Do: Forward downlink message from server end device.
- */
-static void lrwgw_task_handle_downlink(void *pgtw){
-	lorawan_gateway_t *gateway = (lorawan_gateway_t *)pgtw;
+		if((events & LRWGW_EVENT_STOP) || __atomic_load_n(&gateway_stopping, __ATOMIC_ACQUIRE))
+			lrwgw_task_exit(&htask_reactor);
+
+		if(events & LRWGW_EVENT_KEEPALIVE){
+			udpsem_keepalive(&gateway->udpsemtech);
+			gateway_stats.keepalive++;
+		}
+		if(events & LRWGW_EVENT_STAT){
+			/** Rides on the pending PUSH_DATA, else the poll sends it alone */
+			udpsem_push_stat_due(&gateway->udpsemtech);
+			gateway_stats.stat++;
+		}
 
-	while(1){
 		/**
-		 * Process the txpk form udp semtech event.
+		 * Both sources are drained whatever the bits, a downlink has its RX
+		 * window to make so queued PULL_RESPs go before every further uplink.
 		 */
-		lrwgw_handle_txpkt(gateway);
+		while(1){
+			while(lrwgw_handle_txpkt(gateway)) gateway_stats.txpk++;
+			if(!lrwgw_handle_rxpkt(gateway)) break;
+			gateway_stats.rx++;
+		}
 	}
 }
 
@@ -372,91 +473,218 @@ static void lrwgw_task_handle_downlink(void *pgtw){
  */
 static void lrwgw_task_schedule_downlink(void *pgtw){
 	lorawan_gateway_t *gateway = (lorawan_gateway_t *)pgtw;
-	schedule_item_t *item = NULL;
+	lrwgw_downlink_t *item = NULL;
 	(void)gateway;
 
 	while(1){
-		if(xQueueReceive(queue_sched, &item, 100) == pdTRUE){
-			if(item->immediately == true){ /** forward immediately */
-//				LOG_WARN(TAG, "Forward down link immediately");
-
-				lrmac_apply_setting(item->channel, item->setting);
-				lrmac_send_packet(item->packet);
-				lrmac_restore_default_setting(item->channel);
-
-				if(item->setting != NULL) 		  free(item->setting);
-				if(item->packet->payload != NULL) free(item->packet->payload);
-				if(item->packet != NULL) 		  free(item->packet);
-				if(item != NULL) 				  free(item);
+		if(__atomic_load_n(&gateway_stopping, __ATOMIC_ACQUIRE))
+			lrwgw_task_exit(&htask_schedule_downlink);
+
+		/**
+		 * Woken by the TIM2 compare on the earliest downlink, or by TX done.
+		 */
+		item = (lrwgw_downlink_t *)lrmac_timer_expired();
+		if(item == NULL){
+			ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+			continue;
+		}
+
+		if(!lrwgw_transmit(item)){
+			/** Radio still sending the previous downlink */
+			if(!lrmac_timer_schedule(lrmac_timer_now() + LRWGW_SCHED_RETRY_US, item)){
+				LOG_ERROR(TAG, "Downlink on channel %d dropped, schedule full", item->channel);
+				lrwgw_release_downlink(item, true);
 			}
-			else{ /** Schedule down link*/
-				uint32_t delta_t = 0;
-
-				if(udpsem_get_time_stamp() < item->timestamp)
-					delta_t = udpsem_get_time_stamp() + (__UINT32_MAX__ - item->timestamp);
-				else
-					delta_t = udpsem_get_time_stamp() - item->timestamp;
-
-				if(delta_t > item->txdelay){
-//					LOG_WARN(TAG, "Forward down link with schedule, tx delay time = %luus", item->txdelay);
-
-//					lrmac_apply_setting(item->channel, item->setting);
-					lrmac_send_packet(item->packet);
-//					lrmac_restore_default_setting(item->channel);
-
-					if(item->setting != NULL) 		  free(item->setting);
-					if(item->packet->payload != NULL) free(item->packet->payload);
-					if(item->packet != NULL) 		  free(item->packet);
-					if(item != NULL) 				  free(item);
-				}
-				else{
-					xQueueSend(queue_sched, &item, 10);
-				}
+		}
+	}
+}
+
+/**
+ * Leave for lorawan_gateway_stop(). The handle is cleared in a critical
+ * section so no notifier sees it after the task is gone.
+ */
+static void lrwgw_task_exit(TaskHandle_t *ptask){
+	taskENTER_CRITICAL();
+	*ptask = NULL;
+	taskEXIT_CRITICAL();
+
+	xSemaphoreGive(sem_task_exit);
+	vTaskDelete(NULL);
+}
+
+/**
+ * Start the downlink on its radio, false while that radio is still sending
+ * the previous one. TX done restores RX and wakes this task, nothing blocks
+ * here for the time on air. A timed downlink starts on its tmst.
+ */
+static bool lrwgw_transmit(lrwgw_downlink_t *item){
+	bool sent;
+
+	if(lrmac_is_transmitting(item->channel)) return false;
+
+	lrmac_apply_setting(item->channel, &item->setting);
+	sent = lrmac_send_packet(&item->packet, !item->immediately);
+	if(!sent){
+		LOG_ERROR(TAG, "Downlink on channel %d dropped", item->channel);
+		lrmac_restore_default_setting(item->channel);
+	}
+
+	lrwgw_release_downlink(item, !sent);
+
+	return true;
+}
+
+/**
+ * Free a downlink, refund gives its airtime back to the duty cycle ledger
+ * when it never went on air.
+ */
+static void lrwgw_release_downlink(lrwgw_downlink_t *item, bool refund){
+	if(refund)
+		lrmac_duty_refund(item->setting.freq, item->airtime_us);
+	lrwgw_window_release(item, !refund);
+
+	lrwgw_downlink_free(item);
+}
+
+/**
+ * How far ahead of tmst the scheduler takes the radio.
+ */
+static uint32_t lrwgw_wake_lead_us(void){
+#if LRWGW_LBT
+	return LRWGW_SCHED_LEAD_US + lrmac_get_region()->lbt_us;
+#else
+	return LRWGW_SCHED_LEAD_US;
+#endif
+}
+
+/**
+ * Admission of a downlink before it is acked. TOO_LATE when tmst leaves less
+ * than the scheduler lead, TOO_EARLY beyond LRWGW_TX_EARLY_MAX_US, both on the
+ * wrapping 32-bit counter. COLLISION_PACKET when its airtime overlaps a frame
+ * already scheduled on the radio; with least recent RX arbitration the other
+ * radios are tried in that order, least recent RX first, without touching
+ * them. tmst returns the TX start.
+ */
+static udpsem_txpk_ack_error_t lrwgw_admit(udpsem_txpk_t *txpkt, uint8_t *channel, uint32_t airtime_us, uint32_t *tmst){
+	uint32_t now  = lrmac_timer_now();
+	uint32_t lead = lrwgw_wake_lead_us();
+
+	if(txpkt->imme){
+		*tmst = now;
+	}
+	else{
+		int32_t ahead = (int32_t)(txpkt->tmst - now);
+
+		if(ahead < (int32_t)(lead + LRWGW_TX_ADMIT_MARGIN_US)){
+			LOG_WARN(TAG, "Downlink too late, %ldus ahead", ahead);
+			return UDPSEM_ERROR_TOO_LATE;
+		}
+		if(ahead > (int32_t)LRWGW_TX_EARLY_MAX_US){
+			LOG_WARN(TAG, "Downlink too early, %ldus ahead", ahead);
+			return UDPSEM_ERROR_TOO_EARLY;
+		}
+		*tmst = txpkt->tmst;
+	}
+
+	uint32_t start = (txpkt->imme)? now : *tmst - lead;
+	uint32_t end   = *tmst + airtime_us + ((txpkt->imme)? lead : 0);
+
+	if(!lrwgw_window_collides(*channel, start, end)) return UDPSEM_ERROR_NONE;
+
+	if(lrmac_get_tx_arbitration() == LRMAC_TX_ARB_LEAST_RECENT_RX){
+		uint8_t candidate[LRWGW_PHYS_MAX];
+		uint8_t count = lrmac_get_tx_candidates(candidate, LRWGW_PHYS_MAX);
+
+		for(uint8_t i=0; i<count; i++){
+			if(candidate[i] != *channel && !lrwgw_window_collides(candidate[i], start, end)){
+				*channel = candidate[i];
+				return UDPSEM_ERROR_NONE;
 			}
 		}
 	}
+
+	LOG_WARN(TAG, "Downlink collides on channel %d", *channel);
+
+	return UDPSEM_ERROR_COLLISION_PACKET;
 }
 
 /**
- * Gateway task: lrwgw_task_keepalive.
- * To Do: Keep alive connection with server.
+ * Overlap of [start, end) with a live window of channel, wrap safe.
  */
-static void lrwgw_task_keepalive(void *pgtw){
-	lorawan_gateway_t *gateway = (lorawan_gateway_t *)pgtw;
+static bool lrwgw_window_collides(uint8_t channel, uint32_t start, uint32_t end){
+	uint32_t now = lrmac_timer_now();
+	bool collides = false;
 
-	while(1){
-		/**
-		 * Send pull request to keep connection.
-		 */
-		udpsem_keepalive(&gateway->udpsemtech);
+	taskENTER_CRITICAL();
+	for(uint16_t i=0; i<sizeof(tx_window)/sizeof(tx_window[0]) && !collides; i++){
+		tx_window_t *window = &tx_window[i];
 
-		/**
-		 * Keep alive interval, allow switch task to avoid watchdog reset.
-		 */
-		vTaskDelay(gateway->keepalive_interval * 1000UL);
+		if(!window->used || window->channel != channel) continue;
+		if(window->owner == NULL && (int32_t)(window->end - now) <= 0) continue;
+
+		collides = (int32_t)(start - window->end) < 0 && (int32_t)(window->start - end) < 0;
 	}
+	taskEXIT_CRITICAL();
+
+	return collides;
 }
 
 /**
- * Gateway task: lrwgw_task_send_status.
- * To Do: Send gateway status message to server.
+ * Hold the radio of item for its time, slots of frames done are reused.
  */
-static void lrwgw_task_send_status(void *pgtw){
-	lorawan_gateway_t *gateway = (lorawan_gateway_t *)pgtw;
+static bool lrwgw_window_reserve(lrwgw_downlink_t *item){
+	uint32_t now = lrmac_timer_now();
+	uint32_t lead = (item->immediately)? 0 : lrwgw_wake_lead_us();
+	bool reserved = false;
+
+	taskENTER_CRITICAL();
+	for(uint16_t i=0; i<sizeof(tx_window)/sizeof(tx_window[0]) && !reserved; i++){
+		tx_window_t *window = &tx_window[i];
+
+		if(window->used && (window->owner != NULL || (int32_t)(window->end - now) > 0)) continue;
+
+		window->used    = true;
+		window->owner   = item;
+		window->channel = item->channel;
+		window->start   = item->tmst - lead;
+		window->end     = item->tmst + item->airtime_us + ((item->immediately)? lrwgw_wake_lead_us() : 0);
+		reserved = true;
+	}
+	taskEXIT_CRITICAL();
 
-	while(1){
-		/**
-		 * Send status interval, allow switch task to avoid watchdog reset.
-		 */
-		vTaskDelay(gateway->stat_interval * 1000UL);
+	return reserved;
+}
 
-		/**
-		 * Send gateway status.
-		 */
-		udpsem_send_stat(&gateway->udpsemtech);
+/**
+ * A frame gone on air keeps its window until TX done, a dropped one frees it.
+ */
+static void lrwgw_window_release(lrwgw_downlink_t *item, bool on_air){
+	taskENTER_CRITICAL();
+	for(uint16_t i=0; i<sizeof(tx_window)/sizeof(tx_window[0]); i++){
+		tx_window_t *window = &tx_window[i];
+		if(!window->used || window->owner != item) continue;
+
+		window->owner = NULL;
+		if(!on_air) window->used = false;
+		break;
 	}
+	taskEXIT_CRITICAL();
 }
 
+/**
+ * Raise a reactor event, from a task or an interrupt.
+ */
+static void lrwgw_notify(uint32_t event){
+	TaskHandle_t task = htask_reactor;
 
+	if(task == NULL) return;
 
+	if(xPortIsInsideInterrupt())
+		xTaskNotifyFromISR(task, event, eSetBits, NULL);
+	else
+		xTaskNotify(task, event, eSetBits);
+}
 
+static void lrwgw_timer_callback(TimerHandle_t timer){
+	lrwgw_notify((uint32_t)(uintptr_t)pvTimerGetTimerID(timer));
+}
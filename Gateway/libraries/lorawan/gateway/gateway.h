@@ -30,6 +30,28 @@ typedef enum{
 	LORAWAN_GATEWAY_EVENT_UPLINK,
 } lorawan_gateway_event_t;
 
+/**
+ * Gateway reactor, the task forwarding uplinks, admitting downlinks, keeping
+ * alive and sending status. Wakeups against events handled show the idle cost.
+ *
+ * Estimated, not yet measured on the board: the reactor and the downlink
+ * scheduler (LRWGW_REACTOR_STACK_SIZE + LRWGW_SCHED_STACK_SIZE, 12 KB) take
+ * the place of five task stacks of 42 KB in all, about 30 KB less FreeRTOS
+ * heap in RAM_D1. Idle wakeups go from about 200 per second (two 10 tick
+ * queue polls) to the keepalive and stat timers alone. wakeups, timeouts and
+ * the two stack high-water marks below are what confirms both on target.
+ */
+typedef struct{
+	uint32_t wakeups;
+	uint32_t timeouts;       /** Wakeups for a PUSH_DATA deadline */
+	uint32_t rx;             /** Ring entries handled */
+	uint32_t txpk;           /** PULL_RESPs handled */
+	uint32_t keepalive;
+	uint32_t stat;
+	uint32_t stack_free_min; /** Reactor stack never used, bytes */
+	uint32_t sched_stack_free_min; /** Downlink scheduler stack never used, bytes */
+} lorawan_gateway_stats_t;
+
 typedef struct lorawan_gateway lorawan_gateway_t;
 struct lorawan_gateway{
 	udpsem_server_info_t server_info;
@@ -56,6 +78,9 @@ void lorawan_gateway_set_coordinate(lorawan_gateway_t *pgtw, float latitude, flo
 err_t lorawan_gateway_start(lorawan_gateway_t *pgtw);
 void lorawan_gateway_stop(lorawan_gateway_t *pgtw);
 
+void lorawan_gateway_get_stats(lorawan_gateway_stats_t *stats);
+void lorawan_gateway_reset_stats(void);
+
 
 
 #ifdef __cplusplus
@@ -14,37 +14,17 @@
 
 #define LRWGW_SYNCWORD 			  0x34
 
-#define LRWGW_CH0_SF  			  10
-#define LRWGW_CH0_BW  			  125E3
-#define LRWGW_CH0_CDR 			  5
-
-#define LRWGW_CH1_SF  			  10
-#define LRWGW_CH1_BW  			  125E3
-#define LRWGW_CH1_CDR 			  5
-
-#define LRWGW_CH2_SF  			  10
-#define LRWGW_CH2_BW  			  125E3
-#define LRWGW_CH2_CDR 			  5
-
-#define LRWGW_CH3_SF  			  10
-#define LRWGW_CH3_BW  			  125E3
-#define LRWGW_CH3_CDR 			  5
-
-#define LRWGW_CH4_SF  			  10
-#define LRWGW_CH4_BW  			  125E3
-#define LRWGW_CH4_CDR 			  5
-
-#define LRWGW_CH5_SF  			  10
-#define LRWGW_CH5_BW  			  125E3
-#define LRWGW_CH5_CDR 			  5
-
-#define LRWGW_CH6_SF  			  10
-#define LRWGW_CH6_BW  			  125E3
-#define LRWGW_CH6_CDR 			  5
-
-#define LRWGW_CH7_SF  			  10
-#define LRWGW_CH7_BW  			  125E3
-#define LRWGW_CH7_CDR 			  5
+#define LRWGW_DEFAULT_REGION      LRMAC_REGION_AS923 /** Plan used until lrmac_select_region() */
+#define LRWGW_PHYS_MAX            8  /** Radios lrmac can attach */
+#define LRWGW_TX_ARBITRATION      LRMAC_TX_ARB_LEAST_RECENT_RX
+#define LRWGW_TX_DEDICATED_CH     1  /** Transmitter channel of LRMAC_TX_ARB_DEDICATED */
+#define LRWGW_DUTY_CYCLE          1  /** Enforce the region sub-band duty cycle on downlinks */
+#define LRWGW_DUTY_WINDOW_S       3600U
+#define LRWGW_LBT                 1  /** Listen before talk where the region requires it */
+
+#define LRWGW_RX_CAD_SCAN         0  /** Receive SF7..SF12 by CAD instead of the plan channel SF. Opt-in, a scan cycle takes ~64 ms and misses SF7..SF9 preambles */
+#define LRWGW_CAD_SF_MIN          7
+#define LRWGW_CAD_SF_MAX          12
 
 #define LRWGW_STAT_INTERVAL       60U
 #define LRWGW_KEEP_ALIVE          15U
@@ -61,23 +41,26 @@
 
 #define LRWGW_DEFAULT_PROTO_VER   UDPSEM_PROTOVER_2
 
-#define LRWGW_PHYS_RXPKT_QUEUE_SIZE 10
+#define LRWGW_RX_RING_DEPTH         8   /** Frames waiting per radio, power of two */
 #define LRWGW_PHYS_TXPKT_QUEUE_SIZE 10
+#define LRWGW_REACTOR_STACK_SIZE    8192U /** Bytes, uplinks, PULL_RESP admission, keepalive and stat */
+#define LRWGW_SCHED_STACK_SIZE      4096U /** Bytes, TIM2 timed downlink start */
+#define LRWGW_STOP_TIMEOUT_MS       1000U /** Longest lorawan_gateway_stop() waits for each task to leave */
+#define LRWGW_DOWNLINK_POOL_SIZE    8   /** Downlinks from PULL_RESP until on air */
+#define LRWGW_SCHED_SIZE            LRWGW_DOWNLINK_POOL_SIZE
+#define LRWGW_SCHED_TIM_CHANNEL     TIM_CHANNEL_4 /** TIM2 compare channel waking the downlink scheduler */
+#define LRWGW_SCHED_LEAD_US         1500U /** Wake before tmst, retune and FIFO load, plus LBT */
+#define LRWGW_SCHED_RETRY_US        1000U /** Next try while the radio is still transmitting */
+#define LRWGW_TX_ADMIT_MARGIN_US    1000U /** Lead asked on top of the scheduler's, ack to heap */
+#define LRWGW_TX_EARLY_MAX_US       16000000U /** Furthest tmst accepted, RX1 delay is 15 s at most */
 
 #define LRWGW_TIME_UTC_OFFSET_SEC 	7*3600U
 #define LRWGW_BUFFER_SIZE 			512U
 #define LRWGW_HEADER_LENGTH 		12U
 
-#define LRWGW_FREQ_PLANS_AS923
-#define LRWGW_FREQ_PLANS_EU433
-#define LRWGW_FREQ_PLANS_AU915
-
-#ifdef LRWGW_FREQ_PLANS_AS923
-#define LRWGW_FREQ_MIN 923.2
-#define LRWGW_FREQ_MAX 924.8
-#endif
-#define LRWGW_POWER_MIN 2
-#define LRWGW_POWER_MAX 20
+#define LRWGW_PUSH_WINDOW_MS        20U   /** Uplinks this close share one PUSH_DATA, 0 sends each alone */
+#define LRWGW_PUSH_LATENCY_MAX_MS   50U   /** Longest an uplink waits for others */
+#define LRWGW_PUSH_MTU              1472U /** PUSH_DATA budget, one Ethernet frame without IP fragments */
 
 
 #endif /* LORAWAN_GATEWAY_GATEWAY_CONFIG_H_ */
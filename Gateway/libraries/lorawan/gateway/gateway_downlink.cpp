@@ -0,0 +1,127 @@
+/*
+ * gateway_downlink.cpp
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: anh
+ */
+
+#include "lorawan/gateway/gateway_config.h"
+#include "lorawan/gateway/gateway_downlink.h"
+
+#include "string.h"
+#include "stddef.h"
+
+
+/**
+ * The free list head packs the slot index in the low half and a tag in the
+ * high half, bumped by every push and pop so a stale compare-exchange from a
+ * preempted context fails instead of linking a slot twice (ABA).
+ * On Cortex-M7 the exchange is LDREX/STREX, exception entry clears the
+ * monitor, so an interrupted task simply retries.
+ */
+#define LRWGW_DOWNLINK_POOL_EMPTY 0xffffU
+#define LRWGW_DOWNLINK_POOL_INDEX(head) ((uint16_t)((head) & 0xffffU))
+#define LRWGW_DOWNLINK_POOL_TAG(head)   ((head) & 0xffff0000U)
+#define LRWGW_DOWNLINK_POOL_HEAD(tag, index) ((((tag) + 0x10000U) & 0xffff0000U) | (index))
+
+typedef struct{
+	lrwgw_downlink_t downlink; /** Must stay first, lrwgw_downlink_free() casts back */
+	uint16_t         next;
+} lrwgw_downlink_slot_t;
+
+static lrwgw_downlink_slot_t downlink_slot[LRWGW_DOWNLINK_POOL_SIZE];
+static uint32_t downlink_head = LRWGW_DOWNLINK_POOL_EMPTY;
+static lrwgw_downlink_stats_t downlink_stats;
+
+static_assert(LRWGW_DOWNLINK_POOL_SIZE < LRWGW_DOWNLINK_POOL_EMPTY, "Pool index must fit 16 bits");
+
+static void lrwgw_downlink_count(uint32_t *counter, uint32_t value);
+
+
+
+/**
+ * Not safe against concurrent alloc/free, call with the gateway stopped.
+ */
+void lrwgw_downlink_initialize(void){
+	for(uint16_t i=0; i<LRWGW_DOWNLINK_POOL_SIZE; i++)
+		downlink_slot[i].next = (i + 1 < LRWGW_DOWNLINK_POOL_SIZE)? (i + 1) : LRWGW_DOWNLINK_POOL_EMPTY;
+
+	__atomic_store_n(&downlink_head, LRWGW_DOWNLINK_POOL_HEAD(LRWGW_DOWNLINK_POOL_TAG(downlink_head), 0), __ATOMIC_RELEASE);
+	memset((void *)&downlink_stats, 0, sizeof(lrwgw_downlink_stats_t));
+}
+
+lrwgw_downlink_t *lrwgw_downlink_alloc(void){
+	uint32_t head = __atomic_load_n(&downlink_head, __ATOMIC_ACQUIRE);
+	uint16_t index;
+
+	do{
+		index = LRWGW_DOWNLINK_POOL_INDEX(head);
+		if(index == LRWGW_DOWNLINK_POOL_EMPTY){
+			lrwgw_downlink_count(&downlink_stats.exhausted, 1);
+			return NULL;
+		}
+	} while(!__atomic_compare_exchange_n(&downlink_head, &head,
+			LRWGW_DOWNLINK_POOL_HEAD(LRWGW_DOWNLINK_POOL_TAG(head), downlink_slot[index].next),
+			true, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+
+	lrwgw_downlink_slot_t *slot = &downlink_slot[index];
+	memset((void *)&slot->downlink, 0, offsetof(lrwgw_downlink_t, json));
+	slot->downlink.packet = lrmac_packet_t();
+	slot->downlink.packet.payload = slot->downlink.data;
+	slot->downlink.json[0] = 0;
+
+	lrwgw_downlink_count(&downlink_stats.allocs, 1);
+	uint32_t in_use = __atomic_add_fetch(&downlink_stats.in_use, 1, __ATOMIC_RELAXED);
+	uint32_t in_use_max = __atomic_load_n(&downlink_stats.in_use_max, __ATOMIC_RELAXED);
+	while(in_use > in_use_max && !__atomic_compare_exchange_n(&downlink_stats.in_use_max, &in_use_max,
+			in_use, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+	return &slot->downlink;
+}
+
+void lrwgw_downlink_free(lrwgw_downlink_t *downlink){
+	uintptr_t offset = (uintptr_t)downlink - (uintptr_t)downlink_slot;
+
+	if(downlink == NULL) return;
+	if(offset >= sizeof(downlink_slot) || offset % sizeof(lrwgw_downlink_slot_t) != 0){
+		lrwgw_downlink_count(&downlink_stats.invalid_free, 1);
+		return;
+	}
+
+	uint16_t index = (uint16_t)(offset / sizeof(lrwgw_downlink_slot_t));
+	lrwgw_downlink_slot_t *slot = &downlink_slot[index];
+	uint32_t head = __atomic_load_n(&downlink_head, __ATOMIC_RELAXED);
+
+	/** Before the push, once on the list the slot may be taken and counted again */
+	__atomic_sub_fetch(&downlink_stats.in_use, 1, __ATOMIC_RELAXED);
+	do{
+		slot->next = LRWGW_DOWNLINK_POOL_INDEX(head);
+	} while(!__atomic_compare_exchange_n(&downlink_head, &head,
+			LRWGW_DOWNLINK_POOL_HEAD(LRWGW_DOWNLINK_POOL_TAG(head), index),
+			true, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+
+	lrwgw_downlink_count(&downlink_stats.frees, 1);
+}
+
+void lrwgw_downlink_get_stats(lrwgw_downlink_stats_t *stats){
+	*stats = downlink_stats;
+}
+
+/**
+ * Clears the counters, in_use keeps tracking the slots still out.
+ */
+void lrwgw_downlink_reset_stats(void){
+	uint32_t in_use = __atomic_load_n(&downlink_stats.in_use, __ATOMIC_RELAXED);
+
+	__atomic_store_n(&downlink_stats.allocs, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&downlink_stats.frees, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&downlink_stats.exhausted, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&downlink_stats.invalid_free, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&downlink_stats.in_use_max, in_use, __ATOMIC_RELAXED);
+}
+
+
+
+static void lrwgw_downlink_count(uint32_t *counter, uint32_t value){
+	__atomic_fetch_add(counter, value, __ATOMIC_RELAXED);
+}
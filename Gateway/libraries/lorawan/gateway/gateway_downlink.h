@@ -0,0 +1,69 @@
+/*
+ * gateway_downlink.h
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: anh
+ */
+
+#ifndef LORAWAN_GATEWAY_GATEWAY_DOWNLINK_H_
+#define LORAWAN_GATEWAY_GATEWAY_DOWNLINK_H_
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+#include "lorawan/gateway/gateway_config.h"
+#include "lorawan/lrmac/lrmac.h"
+
+
+/**
+ * Group: Downlink descriptor.
+ * One PULL_RESP from the UDP callback to the radio. The datagram JSON is
+ * copied in as received, once parsed the same bytes hold the decoded PHY
+ * payload, so a txpk of a full 255 byte frame (340 base64 characters plus
+ * its fields) fits in one fixed descriptor.
+ */
+#define LRWGW_DOWNLINK_JSON_SIZE 640U
+
+typedef struct{
+	lrmac_packet_t       packet;      /** payload points at data */
+	lrmac_phys_setting_t setting;
+	uint8_t              channel;
+	bool                 immediately;
+	uint32_t             tmst;        /** TIM2 count the TX starts at */
+	uint32_t             airtime_us;  /** Charged to the duty cycle ledger */
+	uint16_t             token;
+	uint16_t             length;      /** JSON characters in json */
+	union{
+		char             json[LRWGW_DOWNLINK_JSON_SIZE];      /** txpk object, NUL terminated, until parsed */
+		uint8_t          data[LRPHYS_MAX_PKT_LENGTH + 1];     /** PHY payload, after parsing */
+	};
+} lrwgw_downlink_t;
+
+typedef struct{
+	uint32_t allocs;
+	uint32_t frees;
+	uint32_t exhausted;    /** PULL_RESP dropped, no descriptor free */
+	uint32_t invalid_free; /** Pointers not owned by the pool */
+	uint32_t in_use;
+	uint32_t in_use_max;
+} lrwgw_downlink_stats_t;
+
+/**
+ * LRWGW_DOWNLINK_POOL_SIZE static descriptors on a lock-free free list, safe
+ * from ISR and task context alike. lrwgw_downlink_alloc() returns a zeroed
+ * descriptor whose packet payload points at its data, or NULL when exhausted.
+ */
+void lrwgw_downlink_initialize(void);
+lrwgw_downlink_t *lrwgw_downlink_alloc(void);
+void lrwgw_downlink_free(lrwgw_downlink_t *downlink);
+
+void lrwgw_downlink_get_stats(lrwgw_downlink_stats_t *stats);
+void lrwgw_downlink_reset_stats(void);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LORAWAN_GATEWAY_GATEWAY_DOWNLINK_H_ */
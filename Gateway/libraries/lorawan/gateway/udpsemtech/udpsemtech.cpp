@@ -16,6 +16,7 @@
 #include "lorawan/lrphys/lrphys.h"
 #include "lorawan/lrmac/lrmac.h"
 #include "lorawan/gateway/gateway.h"
+#include "lorawan/gateway/gateway_downlink.h"
 #include "lorawan/base64/base64.h"
 #include "json/json.hpp"
 
@@ -37,16 +38,16 @@ static const char *TAG = "LoRaWAN";
 static RTC_TimeTypeDef rtc_time;
 static RTC_DateTypeDef rtc_date;
 
-static void  udpsem_random_token(udpsem_t *pudp);
+static void  udpsem_random_token(uint8_t *buffer);
 
 static err_t udpsem_send(udpsem_t *pudp, uint8_t *buf, uint16_t len);
 static void  udpsem_received_handler(void *arg, struct udp_pcb *pcb, struct pbuf *pbuf, const ip_addr_t *addr, u16_t port);
 
-static void  udpsem_config_header(udpsem_t *pudp, udpsem_header_id_t headerid);
+static void  udpsem_config_header(udpsem_t *pudp, uint8_t *buffer, udpsem_header_id_t headerid);
 static void  udpsem_set_timestamp(udpsem_t *pudp);
 
-static int   udpsem_add_stat_feild(udpsem_t *pudp, uint16_t index);
-static int   udpsem_add_rxpk_feild(udpsem_t *pudp, uint16_t index, udpsem_rxpk_t *pkt);
+static int   udpsem_add_stat_feild(udpsem_t *pudp, char *buffer, uint16_t size);
+static int   udpsem_add_rxpk_object(udpsem_t *pudp, char *buffer, uint16_t size, udpsem_rxpk_t *pkt);
 static int   udpsem_add_txpk_ack_feild(udpsem_t *pudp, uint16_t index, const char *error);
 static const char *udpsem_enum_to_error_str(udpsem_txpk_ack_error_t error);
 
@@ -147,74 +148,175 @@ void udpsem_register_event_handler(udpsem_t *pudp, udpsem_event_handler_f event_
 
 /**
  * UpStream.
+ * rxpk objects are gathered in push_buffer and sent as one PUSH_DATA when the
+ * uplinks stop for LRWGW_PUSH_WINDOW_MS, the oldest has waited
+ * LRWGW_PUSH_LATENCY_MAX_MS or the next one would pass LRWGW_PUSH_MTU. All
+ * udpsem_push_*() calls belong to one task.
+ *
+ * Add one uplink to the pending PUSH_DATA, the pending one is sent first when
+ * the uplink does not fit or the oldest is at the latency cap.
  */
-err_t udpsem_push_data(udpsem_t *pudp, udpsem_rxpk_t *prxpkt, uint8_t incl_stat){
-	int index = 0;
+err_t udpsem_push_rxpk(udpsem_t *pudp, udpsem_rxpk_t *prxpkt){
+	char *buffer = (char *)pudp->push_buffer;
+	TickType_t now = xTaskGetTickCount();
+
+	if(pudp->push_count > 0 && now - pudp->push_first >= pdMS_TO_TICKS(LRWGW_PUSH_LATENCY_MAX_MS)){
+		pudp->push_stats.flush_latency++;
+		udpsem_push_flush(pudp);
+	}
 
-	udpsem_config_header(pudp, UDPSEM_HEADERID_PUSH_DATA);
 	udpsem_set_timestamp(pudp);
 
-    pudp->req_buffer[LRWGW_HEADER_LENGTH] = '{';
-    index = LRWGW_HEADER_LENGTH+1 + udpsem_add_rxpk_feild(pudp, LRWGW_HEADER_LENGTH + 1, prxpkt);
+	for(int attempt=0; attempt<2; attempt++){
+		if(pudp->push_count == 0){
+			udpsem_config_header(pudp, pudp->push_buffer, UDPSEM_HEADERID_PUSH_DATA);
+			pudp->push_length = LRWGW_HEADER_LENGTH + snprintf(buffer + LRWGW_HEADER_LENGTH, LRWGW_PUSH_MTU - LRWGW_HEADER_LENGTH, "{\"rxpk\":[");
+			pudp->push_first  = now;
+		}
 
-    if(incl_stat){
-		pudp->req_buffer[index] = ',';
-		index = index+1 + udpsem_add_stat_feild(pudp, index + 1);
-    }
+		/**
+		 * Written past push_length, only kept when it fits with the closing "]}".
+		 */
+		uint16_t index = pudp->push_length + ((pudp->push_count > 0)? 1 : 0);
+		int length = udpsem_add_rxpk_object(pudp, buffer + index, LRWGW_PUSH_MTU - index, prxpkt);
 
-    pudp->req_buffer[index] = '}';
-    pudp->req_buffer[index+1] = 0;
+		if(length > 0 && index + (uint32_t)length + 2 <= LRWGW_PUSH_MTU){
+			if(pudp->push_count > 0) buffer[pudp->push_length] = ',';
+			pudp->push_length = index + length;
+			pudp->push_last   = now;
+			pudp->push_count++;
 
-	err_t ret = udpsem_send(pudp, pudp->req_buffer, index+1);
-	if(ret == ERR_OK){
-		if(pudp->event_handler != NULL){
-			udpsem_event_t event = {
-				.eventid = UDPSEM_EVENTID_SENT_DATA,
-				.version = (udpsem_protocol_version_t)pudp->server_info->udpver,
-				.token   = (uint16_t)((pudp->req_buffer[1]<<8) | pudp->req_buffer[2]),
-				.data    = (void *)pudp->req_buffer,
-			};
-			pudp->event_handler(pudp, event, pudp->event_parameter);
+			return (LRWGW_PUSH_WINDOW_MS == 0)? udpsem_push_flush(pudp) : ERR_OK;
 		}
-		pudp->txnb++;
+		if(pudp->push_count == 0) break;
+
+		pudp->push_stats.flush_mtu++;
+		udpsem_push_flush(pudp);
 	}
-	pudp->ackr = (double)(((double)pudp->ackn / (double)pudp->txnb) * 100.0);
 
-	return ERR_OK;
+	LOG_ERROR(TAG, "rxpk of %d bytes over the PUSH_DATA budget", prxpkt->size);
+	pudp->push_stats.dropped++;
+
+	return ERR_BUF;
 }
 
-err_t udpsem_send_stat(udpsem_t *pudp){
-	int index = 0;
+/**
+ * Send the pending PUSH_DATA now, with the stat object when it is due. A stat
+ * that no longer fits follows in a datagram of its own.
+ */
+err_t udpsem_push_flush(udpsem_t *pudp){
+	char *buffer = (char *)pudp->push_buffer;
+	uint8_t count = pudp->push_count;
+	uint16_t index = pudp->push_length;
+	bool stat = pudp->push_stat;
+
+	if(count == 0 && !stat) return ERR_OK;
+
+	if(count == 0){
+		udpsem_config_header(pudp, pudp->push_buffer, UDPSEM_HEADERID_PUSH_DATA);
+		udpsem_set_timestamp(pudp);
+		index = LRWGW_HEADER_LENGTH;
+		buffer[index++] = '{';
+	}
+	else
+		buffer[index++] = ']';
+
+	if(stat){
+		uint16_t start = index + ((count > 0)? 1 : 0);
+		int length = udpsem_add_stat_feild(pudp, buffer + start, LRWGW_PUSH_MTU - start);
 
-	udpsem_config_header(pudp, UDPSEM_HEADERID_PUSH_DATA);
-    udpsem_set_timestamp(pudp);
+		if(length > 0 && start + (uint32_t)length + 1 <= LRWGW_PUSH_MTU){
+			if(count > 0){
+				buffer[index] = ',';
+				pudp->push_stats.stat_merged++;
+			}
+			index = start + length;
+			stat = false;
+		}
+		else if(count == 0){
+			LOG_ERROR(TAG, "stat over the PUSH_DATA budget");
+			stat = false;
+		}
+		pudp->push_stat = stat;
+	}
+	buffer[index++] = '}';
 
-    pudp->req_buffer[LRWGW_HEADER_LENGTH] = '{';
-    index = LRWGW_HEADER_LENGTH + udpsem_add_stat_feild(pudp, LRWGW_HEADER_LENGTH + 1) + 1;
-    pudp->req_buffer[index] = '}';
-    pudp->req_buffer[index+1] = 0;
+	pudp->push_count  = 0;
+	pudp->push_length = 0;
 
-	err_t ret = udpsem_send(pudp, pudp->req_buffer, index+1);
+	err_t ret = udpsem_send(pudp, pudp->push_buffer, index);
 	if(ret == ERR_OK){
 		if(pudp->event_handler != NULL){
 			udpsem_event_t event = {
-				.eventid = UDPSEM_EVENTID_SENT_STATE,
+				.eventid = (count > 0)? UDPSEM_EVENTID_SENT_DATA : UDPSEM_EVENTID_SENT_STATE,
 				.version = (udpsem_protocol_version_t)pudp->server_info->udpver,
-				.token   = (uint16_t)((pudp->req_buffer[1]<<8) | pudp->req_buffer[2]),
-				.data    = (void *)pudp->req_buffer,
+				.token   = (uint16_t)((pudp->push_buffer[1]<<8) | pudp->push_buffer[2]),
+				.data    = (void *)pudp->push_buffer,
 			};
 			pudp->event_handler(pudp, event, pudp->event_parameter);
 		}
+		pudp->txnb++;
+	}
+	else
+		pudp->push_stats.dropped += count;
+	pudp->ackr = (double)(((double)pudp->ackn / (double)pudp->txnb) * 100.0);
+
+	if(count > 0){
+		pudp->push_stats.datagrams++;
+		pudp->push_stats.frames += count;
+		if(count > pudp->push_stats.frames_max) pudp->push_stats.frames_max = count;
 	}
 
-	return ret;
+	return (stat)? udpsem_push_flush(pudp) : ret;
+}
+
+/**
+ * Send what is due, returns the ticks until the pending PUSH_DATA will be,
+ * portMAX_DELAY when nothing is pending.
+ */
+TickType_t udpsem_push_poll(udpsem_t *pudp){
+	TickType_t now    = xTaskGetTickCount();
+	TickType_t window = pdMS_TO_TICKS(LRWGW_PUSH_WINDOW_MS);
+	TickType_t cap    = pdMS_TO_TICKS(LRWGW_PUSH_LATENCY_MAX_MS);
+
+	if(pudp->push_count == 0){
+		if(pudp->push_stat) udpsem_push_flush(pudp);
+		return portMAX_DELAY;
+	}
+
+	TickType_t idle = now - pudp->push_last;
+	TickType_t age  = now - pudp->push_first;
+
+	if(age >= cap || idle >= window || pudp->push_stat){
+		if(age >= cap) pudp->push_stats.flush_latency++;
+		else if(idle >= window) pudp->push_stats.flush_window++;
+		udpsem_push_flush(pudp);
+		return portMAX_DELAY;
+	}
+
+	return (window - idle < cap - age)? window - idle : cap - age;
+}
+
+/**
+ * The stat object rides on the next PUSH_DATA, or goes at the next poll.
+ */
+void udpsem_push_stat_due(udpsem_t *pudp){
+	pudp->push_stat = true;
+}
+
+void udpsem_get_push_stats(udpsem_t *pudp, udpsem_push_stats_t *stats){
+	*stats = pudp->push_stats;
+}
+
+void udpsem_reset_push_stats(udpsem_t *pudp){
+	memset((void *)&pudp->push_stats, 0, sizeof(udpsem_push_stats_t));
 }
 
 /**
  * DownStream.
  */
 err_t udpsem_keepalive(udpsem_t *pudp){
-	udpsem_config_header(pudp, UDPSEM_HEADERID_PULL_DATA);
+	udpsem_config_header(pudp, pudp->req_buffer, UDPSEM_HEADERID_PULL_DATA);
 	pudp->req_buffer[LRWGW_HEADER_LENGTH] = 0;
 
 	err_t ret = udpsem_send(pudp, pudp->req_buffer, LRWGW_HEADER_LENGTH);
@@ -233,15 +335,19 @@ err_t udpsem_keepalive(udpsem_t *pudp){
 	return ERR_OK;
 }
 
-err_t udpsem_send_tx_ack(udpsem_t *pudp, udpsem_txpk_ack_error_t error){
-	int index = 0;
+/**
+ * token is the one of the PULL_RESP being answered, PULL_RESPs keep coming in
+ * while earlier ones are still being admitted.
+ */
+err_t udpsem_send_tx_ack(udpsem_t *pudp, uint16_t token, udpsem_txpk_ack_error_t error){
+	int index = LRWGW_HEADER_LENGTH;
 
-	udpsem_config_header(pudp, UDPSEM_HEADERID_TX_ACK);
-    pudp->req_buffer[1]  = (uint8_t)((pudp->txack_token>>8) & 0xFF);
-    pudp->req_buffer[2]  = (uint8_t)(pudp->txack_token & 0xFF);
+	udpsem_config_header(pudp, pudp->req_buffer, UDPSEM_HEADERID_TX_ACK);
+    pudp->req_buffer[1]  = (uint8_t)((token>>8) & 0xFF);
+    pudp->req_buffer[2]  = (uint8_t)(token & 0xFF);
 
     const char *error_str = udpsem_enum_to_error_str(error);
-	udpsem_add_txpk_ack_feild(pudp, LRWGW_HEADER_LENGTH, error_str);
+	index += udpsem_add_txpk_ack_feild(pudp, index, error_str);
 
 	pudp->req_buffer[index] = 0;
 
@@ -268,25 +374,19 @@ BaseType_t udpsem_txpkt_available(udpsem_t *pudp, udpsem_txpk_t *ptxpkt){
 }
 
 udpsem_txpk_ack_error_t  udpsem_check_error(udpsem_txpk_t *ptxpkt, uint32_t current_time){
-	/** Check frequency */
-	if(ptxpkt->freq < LRWGW_FREQ_MIN || ptxpkt->freq > LRWGW_FREQ_MAX){
+	const lrmac_region_t *region = lrmac_get_region();
+
+	/** Check frequency against the active region plan */
+	if(!lrmac_region_check_freq(region, lrmac_region_freq_hz(ptxpkt->freq))){
 		LOG_DEBUG(TAG, "Down link invalid frequency");
 		return UDPSEM_ERROR_TX_FREQ;
 	}
 	/** Check power */
-	if(ptxpkt->powe < LRWGW_POWER_MIN || ptxpkt->powe > LRWGW_POWER_MAX){
+	if(!lrmac_region_check_power(region, (int8_t)ptxpkt->powe)){
 		LOG_DEBUG(TAG, "Down link invalid tx power");
 		return UDPSEM_ERROR_TX_POWER;
 	}
-	/** Check response time */
-//	if(ptxpkt->tmst < current_time){
-//		LOG_DEBUG(TAG, "Down link message too early");
-//		return UDPSEM_ERROR_TOO_EARLY;
-//	}
-//	else{
-//		LOG_DEBUG(TAG, "Down link message to late");
-//		return UDPSEM_ERROR_TOO_LATE;
-//	}
+	/** Timing and collisions are admitted by the gateway, against its schedule */
 
 	return UDPSEM_ERROR_NONE;
 }
@@ -321,14 +421,14 @@ static void  udpsem_update_rtc(void){
     HAL_RTC_SetDate(&hrtc, &rtc_date, RTC_FORMAT_BIN);
 }
 
-static void udpsem_random_token(udpsem_t *pudp){
+static void udpsem_random_token(uint8_t *buffer){
 	uint32_t val;
 	extern RNG_HandleTypeDef hrng;
 
 	HAL_RNG_GenerateRandomNumber(&hrng, &val);
 
-	pudp->req_buffer[1]  = (uint8_t)((val>>8) & 0xFF);
-	pudp->req_buffer[2]  = (uint8_t)(val & 0xFF);
+	buffer[1]  = (uint8_t)((val>>8) & 0xFF);
+	buffer[2]  = (uint8_t)(val & 0xFF);
 }
 
 
@@ -366,26 +466,40 @@ static void udpsem_received_handler(void *arg, struct udp_pcb *pcb, struct pbuf
 			break;
 
     		case UDPSEM_HEADERID_PULL_PESP:{
-    			uint8_t *payload = NULL;
-
-    	    	payload = (uint8_t *)malloc(pbuf->len * sizeof(uint8_t) + 1);
-    	    	if(payload == NULL){
-    	    		LOG_ERROR(TAG, "Memory exhausted, malloc fail at %s -> %d", __FUNCTION__, __LINE__);
-    	    		pbuf_free(pbuf);
-    	    		return;
-    	    	}
-    	    	memset(payload, 0, pbuf->len);
-    	    	memcpy(payload, (uint8_t *)pbuf->payload, pbuf->len);
-    	    	payload[pbuf->len] = 0;
+    			/**
+    			 * The JSON after the 4 byte header goes straight into a pooled
+    			 * downlink descriptor, no heap on the way to the radio.
+    			 */
+    			lrwgw_downlink_t *downlink = NULL;
+    			uint16_t length = (pbuf->tot_len > 4U)? (uint16_t)(pbuf->tot_len - 4U) : 0;
 
     			pudp->dwnb++;
-    			pudp->txack_token = (uint16_t)((udp_buffer[1]<<8) | udp_buffer[2]);
     			event.eventid = UDPSEM_EVENTID_RECV_DATA;
 
-    			if((xPortIsInsideInterrupt())?
-    					xQueueSendFromISR(*pudp->pqueue_resp, &payload, NULL):
-						xQueueSend(*pudp->pqueue_resp, &payload, 10) == pdFALSE){
+    			if(length >= LRWGW_DOWNLINK_JSON_SIZE){
+    	    		LOG_ERROR(TAG, "PULL_RESP of %d bytes too large at %s -> %d", length, __FUNCTION__, __LINE__);
+    	    		break;
+    			}
+    			downlink = lrwgw_downlink_alloc();
+    	    	if(downlink == NULL){
+    	    		LOG_ERROR(TAG, "No downlink descriptor free at %s -> %d", __FUNCTION__, __LINE__);
+    	    		break;
+    	    	}
+    	    	downlink->token  = event.token;
+    	    	downlink->length = pbuf_copy_partial(pbuf, downlink->json, length, 4U);
+    	    	downlink->json[downlink->length] = 0;
+
+    			/** Gateway stopped, its queue is gone */
+    			QueueHandle_t queue = *pudp->pqueue_resp;
+    			if(queue == NULL){
+    				lrwgw_downlink_free(downlink);
+    				break;
+    			}
+    			if(((xPortIsInsideInterrupt())?
+    					xQueueSendFromISR(queue, &downlink, NULL):
+						xQueueSend(queue, &downlink, 10)) == pdFALSE){
     				LOG_ERROR(TAG, "Queue full, send to queue fail at %s -> %d", __FUNCTION__, __LINE__);
+    				lrwgw_downlink_free(downlink);
     			}
     		}
 			break;
@@ -404,22 +518,22 @@ static void udpsem_received_handler(void *arg, struct udp_pcb *pcb, struct pbuf
 
 
 
-static void  udpsem_config_header(udpsem_t *pudp, udpsem_header_id_t headerid){
+static void  udpsem_config_header(udpsem_t *pudp, uint8_t *buffer, udpsem_header_id_t headerid){
 	if(headerid == UDPSEM_HEADERID_PUSH_ACK || headerid == UDPSEM_HEADERID_PULL_ACK) return;
 
-	pudp->req_buffer[0]  = (uint8_t)((pudp->server_info->udpver));
+	buffer[0]  = (uint8_t)((pudp->server_info->udpver));
 
-	udpsem_random_token(pudp);
-	pudp->req_buffer[3]  = (uint8_t)headerid;
+	udpsem_random_token(buffer);
+	buffer[3]  = (uint8_t)headerid;
 
-	pudp->req_buffer[4]  = (uint8_t)((pudp->gtw_info->id>>56) & 0xFF);
-	pudp->req_buffer[5]  = (uint8_t)((pudp->gtw_info->id>>48) & 0xFF);
-	pudp->req_buffer[6]  = (uint8_t)((pudp->gtw_info->id>>40) & 0xFF);
-	pudp->req_buffer[7]  = (uint8_t)((pudp->gtw_info->id>>32) & 0xFF);
-	pudp->req_buffer[8]  = (uint8_t)((pudp->gtw_info->id>>24) & 0xFF);
-	pudp->req_buffer[9]  = (uint8_t)((pudp->gtw_info->id>>16) & 0xFF);
-	pudp->req_buffer[10] = (uint8_t)((pudp->gtw_info->id>>8 ) & 0xFF);
-	pudp->req_buffer[11] = (uint8_t)((pudp->gtw_info->id      & 0xFF));
+	buffer[4]  = (uint8_t)((pudp->gtw_info->id>>56) & 0xFF);
+	buffer[5]  = (uint8_t)((pudp->gtw_info->id>>48) & 0xFF);
+	buffer[6]  = (uint8_t)((pudp->gtw_info->id>>40) & 0xFF);
+	buffer[7]  = (uint8_t)((pudp->gtw_info->id>>32) & 0xFF);
+	buffer[8]  = (uint8_t)((pudp->gtw_info->id>>24) & 0xFF);
+	buffer[9]  = (uint8_t)((pudp->gtw_info->id>>16) & 0xFF);
+	buffer[10] = (uint8_t)((pudp->gtw_info->id>>8 ) & 0xFF);
+	buffer[11] = (uint8_t)((pudp->gtw_info->id      & 0xFF));
 }
 
 static void  udpsem_set_timestamp(udpsem_t *pudp){
@@ -443,7 +557,7 @@ static void  udpsem_set_timestamp(udpsem_t *pudp){
 	pudp->time_stamp = udpsem_get_time_stamp();
 }
 
-static int udpsem_add_stat_feild(udpsem_t *pudp, uint16_t index){
+static int udpsem_add_stat_feild(udpsem_t *pudp, char *buffer, uint16_t size){
 /**
 	{
 		"stat":{...}
@@ -465,7 +579,7 @@ static int udpsem_add_stat_feild(udpsem_t *pudp, uint16_t index){
 	snprintf(pudp->longitude, 10, "%.05f", pudp->gtw_info->longitude);
 	snprintf(pudp->altitude,  10, "%d",    pudp->gtw_info->altitude);
 
-	return snprintf((char *)(pudp->req_buffer+index), LRWGW_BUFFER_SIZE-index,
+	return snprintf(buffer, size,
 		"\"stat\":{"\
 			"\"time\":\"%s\","\
 			"\"lati\":%s,"\
@@ -497,7 +611,7 @@ static int udpsem_add_stat_feild(udpsem_t *pudp, uint16_t index){
 	);
 }
 
-static int udpsem_add_rxpk_feild(udpsem_t *pudp, uint16_t index, udpsem_rxpk_t *pkt){
+static int udpsem_add_rxpk_object(udpsem_t *pudp, char *buffer, uint16_t size, udpsem_rxpk_t *pkt){
 /**
 	{
 		"rxpk":[ {...}, ...]
@@ -517,46 +631,49 @@ static int udpsem_add_rxpk_feild(udpsem_t *pudp, uint16_t index, udpsem_rxpk_t *
 	 codr | string | LoRa ECC coding rate identifier
 	 rssi | number | RSSI in dBm (signed integer, 1 dB precision)
 	 lsnr | number | Lora SNR ratio in dB (signed float, 0.1 dB precision)
+	 foff | number | LoRa frequency offset in Hz (signed integer)
 	 size | number | RF packet payload size in bytes (unsigned integer)
 	 data | string | Base64 encoded RF packet payload, padded
 */
-	char *base64_out = (char *)malloc(LRWGW_BUFFER_SIZE);
+	char base64_out[(LRPHYS_MAX_PKT_LENGTH + 2) / 3 * 4 + 1];
 
-	bin_to_b64((const uint8_t *)pkt->data, pkt->size, base64_out, 400);
+	bin_to_b64((const uint8_t *)pkt->data, pkt->size, base64_out, sizeof(base64_out));
 
-	int i = snprintf((char *)(pudp->req_buffer+index), LRWGW_BUFFER_SIZE-index,
-		"\"rxpk\":["\
+	/**
+	 * Fixed point to text with integer formatting only, MHz with Hz precision
+	 * and SNR from 0.25 dB steps.
+	 */
+	uint8_t snr_abs = (pkt->snr < 0)? -pkt->snr : pkt->snr;
+
+	return snprintf(buffer, size,
 			"{"\
 				"\"chan\":%d,"\
 				"\"rfch\":%d,"\
-				"\"freq\":%.03f,"\
+				"\"freq\":%lu.%06lu,"\
 				"\"stat\":%d,"\
 				"\"modu\":\"LORA\","\
 				"\"datr\":\"SF%dBW%d\","\
 				"\"codr\":\"4/%d\","\
 				"\"rssi\":%d,"\
-				"\"lsnr\":%.2f,"\
+				"\"lsnr\":%s%d.%02d,"\
+				"\"foff\":%ld,"\
 				"\"size\":%d,"\
 				"\"data\":\"%s\","\
 				"\"tmst\":%lu"\
-			"}"\
-		"]",
+			"}",
 		pkt->channel,
 		pkt->rf_chain,
-		pkt->freq,
+		pkt->freq / 1000000, pkt->freq % 1000000,
 		pkt->crc_stat,
 		pkt->sf, pkt->bw,
 		pkt->codr,
 		pkt->rssi,
-		pkt->snr,
+		(pkt->snr < 0)? "-" : "", snr_abs / 4, (snr_abs % 4) * 25,
+		(long)pkt->foff,
 		pkt->size,
 		base64_out,
-		(uint32_t)pudp->time_stamp
+		(pkt->tmst != 0)? pkt->tmst : (uint32_t)pudp->time_stamp
 	);
-
-	free(base64_out);
-
-	return i;
 }
 
 static int udpsem_add_txpk_ack_feild(udpsem_t *pudp, uint16_t index, const char *error){
@@ -585,6 +702,9 @@ static const char *udpsem_enum_to_error_str(udpsem_txpk_ack_error_t error){
 		case UDPSEM_ERROR_TX_FREQ:
 			return "TX_FREQ";
 		break;
+		case UDPSEM_ERROR_COLLISION_PACKET:
+			return "COLLISION_PACKET";
+		break;
 		default:
 			return "NONE";
 		break;
@@ -595,14 +715,17 @@ static const char *udpsem_enum_to_error_str(udpsem_txpk_ack_error_t error){
 
 
 
-bool udpsem_parse_pull_resp(char *buffer, udpsem_txpk_t *txpkt){
-	uint8_t modu_len = 0;
-	uint8_t data_len = 0;
+/**
+ * Parse the txpk object of buffer into txpkt, the base64 data decoded into
+ * payload. buffer is only read by json::parse(), payload may overlap it.
+ */
+bool udpsem_parse_pull_resp(char *buffer, udpsem_txpk_t *txpkt, uint8_t *payload, uint16_t payload_size){
 	json txpk_json;
 	json jsonData;
+	int  size;
 
 
-	jsonData = json::parse(buffer);
+	jsonData = json::parse(buffer, nullptr, false);
     if (jsonData.is_discarded()) {
         LOG_ERROR(TAG, "Error parse JSON data");
         return false;
@@ -627,22 +750,22 @@ bool udpsem_parse_pull_resp(char *buffer, udpsem_txpk_t *txpkt){
 	txpkt->fdev = (txpk_json.find("fdev") != txpk_json.end())? (uint32_t)   txpk_json["fdev"]:0;
 	txpkt->ipol = (txpk_json.find("ipol") != txpk_json.end())? (bool)       txpk_json["ipol"]:false;
 	txpkt->ncrc = (txpk_json.find("ncrc") != txpk_json.end())? (bool)       txpk_json["ncrc"]:false;
-	string data = (txpk_json.find("data") != txpk_json.end())? (string)     txpk_json["data"]:" ";
+	string data = (txpk_json.find("data") != txpk_json.end())? (string)     txpk_json["data"]:"";
 	txpkt->size = (txpk_json.find("size") != txpk_json.end())? (uint8_t)    txpk_json["size"]:0;
 
 	sscanf(codr.c_str(), "4/%hhu", &txpkt->codr);
+	sscanf(datr.c_str(), "SF%hhuBW%d", &txpkt->sf, &txpkt->bw);
 
-	modu_len = strlen((char *)modu.c_str());
-	txpkt->modu = (char *)malloc(modu_len * sizeof(char) + 1);
-	memcpy(txpkt->modu, (char *)modu.c_str(), modu_len);
-	txpkt->modu[modu_len] = 0;
-
-	data_len = strlen((char *)data.c_str());
-	txpkt->data = (uint8_t *)malloc(data_len * sizeof(uint8_t) + 1);
-	memcpy(txpkt->data, (char *)data.c_str(), data_len);
-	txpkt->data[data_len] = 0;
+	strncpy(txpkt->modu, modu.c_str(), sizeof(txpkt->modu) - 1);
+	txpkt->modu[sizeof(txpkt->modu) - 1] = 0;
 
-	sscanf(datr.c_str(), "SF%hhuBW%d", &txpkt->sf, &txpkt->bw);
+	size = b64_to_bin(data.c_str(), data.length(), payload, payload_size);
+	if(size < 0 || size > LRPHYS_MAX_PKT_LENGTH){
+		LOG_ERROR(TAG, "Invalid txpk data");
+		return false;
+	}
+	txpkt->data = payload;
+	txpkt->size = (uint8_t)size;
 
 	return true;
 }
@@ -69,6 +69,7 @@ typedef enum{
 	UDPSEM_ERROR_TOO_EARLY,
 	UDPSEM_ERROR_TX_POWER,
 	UDPSEM_ERROR_TX_FREQ,
+	UDPSEM_ERROR_COLLISION_PACKET,
 } udpsem_txpk_ack_error_t;
 
 /**
@@ -111,6 +112,22 @@ typedef struct{
 } udpsem_gateway_info_t;
 
 
+/**
+ * Uplink coalescing, frames per datagram is the coalescing ratio, left to
+ * the reader to keep the counters integer.
+ */
+typedef struct{
+	uint32_t datagrams;     /** PUSH_DATA sent with rxpk */
+	uint32_t frames;        /** rxpk objects in them */
+	uint32_t flush_window;  /** Sent, no uplink for LRWGW_PUSH_WINDOW_MS */
+	uint32_t flush_latency; /** Sent, the oldest at LRWGW_PUSH_LATENCY_MAX_MS */
+	uint32_t flush_mtu;     /** Sent, the next uplink would pass LRWGW_PUSH_MTU */
+	uint32_t stat_merged;   /** stat objects carried along with rxpk */
+	uint32_t dropped;       /** Uplinks over the budget or lost to the stack */
+	uint8_t  frames_max;
+} udpsem_push_stats_t;
+
+
 typedef struct udpsem_handler udpsem_t;
 typedef void    (*udpsem_event_handler_f)(udpsem_t *pudp, udpsem_event_t event, void *param);
 typedef uint32_t(*udpsem_get_timestamp_f)(void);
@@ -138,9 +155,17 @@ struct udpsem_handler{
     char      longitude[10];
     char      altitude[10];
 
-    uint16_t txack_token;
-
 	uint8_t  req_buffer[LRWGW_BUFFER_SIZE];
+
+	/** Pending PUSH_DATA, owned by the uplink task */
+	uint8_t    push_buffer[LRWGW_PUSH_MTU];
+	uint16_t   push_length = 0;
+	uint8_t    push_count = 0;
+	bool       push_stat = false;
+	TickType_t push_first = 0;
+	TickType_t push_last = 0;
+	udpsem_push_stats_t push_stats;
+
 	char     utc_time[40];
 	uint32_t time_stamp;
 
@@ -162,15 +187,17 @@ struct udpsem_handler{
 typedef struct{
 	uint8_t  channel 	  = 0;
 	uint16_t rf_chain 	  = 0;
-	double   freq 		  = 923.00000;
+	uint32_t freq 		  = 923000000; /** Hz */
 	int8_t   crc_stat 	  = 1;
 	uint8_t  sf 		  = 7;
 	uint16_t bw 		  = 125;
 	uint8_t  codr 		  = 5;
-	int8_t   rssi 		  = -1;
-	double   snr          = -1;
+	int16_t  rssi 		  = -1;
+	int8_t   snr          = -4;        /** 0.25 dB steps */
 	uint8_t  *data 	      = NULL;
 	uint8_t  size         = 23;
+	uint32_t tmst         = 0; /** Counter latched at RX done, 0 falls back to the push time */
+	int32_t  foff         = 0; /** Frequency offset in Hz */
 } udpsem_rxpk_t;
 
 
@@ -181,7 +208,7 @@ typedef struct{
 	uint16_t rfch 	      = 0;
 	double   freq 		  = 923.00000;
 	uint8_t  powe         = 20;
-	char     *modu        = (char *)"LORA";
+	char     modu[8]      = "LORA";
 	uint8_t  sf 		  = 7;
 	int      bw 		  = 125;
 	uint8_t  codr 		  = 5;
@@ -189,7 +216,7 @@ typedef struct{
 	uint32_t fdev         = 0;
 	bool     ipol         = false;
 	bool     ncrc  		  = false;
-	uint8_t  *data        = NULL;
+	uint8_t  *data        = NULL;  /** Decoded payload, in the buffer given to udpsem_parse_pull_resp() */
 	uint8_t  size  		  = 23;
 } udpsem_txpk_t;
 
@@ -204,13 +231,17 @@ err_t udpsem_disconnect(udpsem_t *pudp);
 void udpsem_register_port_function(udpsem_get_timestamp_f f_get_timestamp, udpsem_get_random_f f_get_random, udpsem_get_rtc_f f_get_rtc, udpsem_set_rtc_f f_set_rtc);
 void udpsem_register_event_handler(udpsem_t *pudp, udpsem_event_handler_f event_handler_function, void *param);
 
-err_t udpsem_push_data(udpsem_t *pudp, udpsem_rxpk_t *prxpkt, uint8_t incl_stat);
-err_t udpsem_send_stat(udpsem_t *pudp);
+err_t udpsem_push_rxpk(udpsem_t *pudp, udpsem_rxpk_t *prxpkt);
+err_t udpsem_push_flush(udpsem_t *pudp);
+TickType_t udpsem_push_poll(udpsem_t *pudp);
+void  udpsem_push_stat_due(udpsem_t *pudp);
+void  udpsem_get_push_stats(udpsem_t *pudp, udpsem_push_stats_t *stats);
+void  udpsem_reset_push_stats(udpsem_t *pudp);
 err_t udpsem_keepalive(udpsem_t *pudp);
-err_t udpsem_send_tx_ack(udpsem_t *pudp, udpsem_txpk_ack_error_t error);
+err_t udpsem_send_tx_ack(udpsem_t *pudp, uint16_t token, udpsem_txpk_ack_error_t error);
 
 BaseType_t udpsem_txpkt_available(udpsem_t *pudp, udpsem_txpk_t *ptxpkt);
-bool  udpsem_parse_pull_resp(char *buffer, udpsem_txpk_t *txpkt);
+bool  udpsem_parse_pull_resp(char *buffer, udpsem_txpk_t *txpkt, uint8_t *payload, uint16_t payload_size);
 udpsem_txpk_ack_error_t  udpsem_check_error(udpsem_txpk_t *ptxpkt, uint32_t current_time);
 uint32_t udpsem_get_time_stamp(void);
 
@@ -7,9 +7,12 @@
 
 #include "lorawan/gateway/gateway_config.h"
 #include "lorawan/lrmac/lrmac.h"
+#include "lorawan/lrmac/lrmac_ring.h"
+#include "lorawan/lrmac/lrmac_duty.h"
+#include "lorawan/lrmac/lrmac_timer.h"
 
 #include "FreeRTOS.h"
-#include "queue.h"
+#include "task.h"
 
 #include "stdlib.h"
 #include "string.h"
@@ -19,195 +22,511 @@
 
 static const char *TAG = "LoRaMAC";
 
+#define LRMAC_TX_TIMEOUT_MARGIN_MS 100U
 
 
-static lrphys *phys_corresponds_channel[8] = {NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL};
-static const long phys_channel_freq_table[8] = {
-    (long)9232E5L,
-	(long)9234E5L,
-	(long)9236E5L,
-	(long)9238E5L,
-	(long)9240E5L,
-	(long)9242E5L,
-	(long)9244E5L,
-	(long)9246E5L
-};
-static const uint8_t phys_channel_sf_table[8] = {
-	LRWGW_CH0_SF,
-	LRWGW_CH1_SF,
-	LRWGW_CH2_SF,
-	LRWGW_CH3_SF,
-	LRWGW_CH4_SF,
-	LRWGW_CH5_SF,
-	LRWGW_CH6_SF,
-	LRWGW_CH7_SF
-};
-static const long phys_channel_bw_table[8] = {
-	(long)LRWGW_CH0_BW,
-	(long)LRWGW_CH1_BW,
-	(long)LRWGW_CH2_BW,
-	(long)LRWGW_CH3_BW,
-	(long)LRWGW_CH4_BW,
-	(long)LRWGW_CH5_BW,
-	(long)LRWGW_CH6_BW,
-	(long)LRWGW_CH7_BW
-};
-static const uint8_t phys_channel_cdr_table[8] = {
-	LRWGW_CH0_CDR,
-	LRWGW_CH1_CDR,
-	LRWGW_CH2_CDR,
-	LRWGW_CH3_CDR,
-	LRWGW_CH4_CDR,
-	LRWGW_CH5_CDR,
-	LRWGW_CH6_CDR,
-	LRWGW_CH7_CDR
-};
-static lrmac_phys_setting_t phys_settings_table[8];
-static QueueHandle_t *pqueue;
+
+/**
+ * One attached radio and the plan channel it serves.
+ */
+typedef struct{
+	lrphys             *phys;
+	uint8_t            channel;
+	lrphys_profile_t   profile;       /** Default RX register image of the channel */
+	lrmac_turnaround_t turnaround;
+	uint32_t           apply_cycles;
+	uint32_t           txdone_cycles;
+	bool               tx_busy;       /** Set by the sender, cleared at TX done */
+	bool               tx_claimed;    /** Taken off RX for a downlink, until restore */
+	TickType_t         rx_tick;       /** Last frame received */
+	uint32_t           tx_cycles;     /** TX start */
+	TickType_t         tx_tick;
+	uint8_t            tx_sf;         /** Modem setting the next TX goes out with */
+	long               tx_bw;
+	uint8_t            tx_cdr;
+	uint16_t           tx_prea;
+	bool               tx_crc;
+	lrmac_tx_stats_t   tx_stats;
+	lrmac_ring_t       ring;
+} lrmac_radio_t;
+
+static lrmac_radio_t mac_radio[LRWGW_PHYS_MAX];
+static lrmac_radio_t *mac_channel_radio[LRMAC_REGION_CHANNEL_MAX];
+static uint8_t mac_raster_channel[LRMAC_REGION_RASTER_SIZE];
+static const lrmac_region_t *mac_region = NULL;
+static TaskHandle_t *pconsumer;
+static TaskHandle_t *ptx_listener = NULL;
+static lrmac_tx_arbitration_t mac_tx_arbitration = LRWGW_TX_ARBITRATION;
+static uint8_t mac_tx_dedicated = LRWGW_TX_DEDICATED_CH;
+
+static_assert((LRWGW_RX_RING_DEPTH & (LRWGW_RX_RING_DEPTH - 1)) == 0, "LRWGW_RX_RING_DEPTH must be a power of two");
 
 static void lrmac_phys_event_handler(void *arg, lrphys_eventid_t id, uint8_t len);
-static uint8_t lrmac_get_phys_channel(lrphys *phys);
+static lrmac_radio_t *lrmac_get_radio(uint8_t channel);
+static void lrmac_bind_radio(lrmac_radio_t *radio);
+static void lrmac_use_region(const lrmac_region_t *region);
+static uint32_t lrmac_cycles_to_us(uint32_t cycles);
+static void lrmac_start_receive(lrphys *phys);
+static void lrmac_notify_consumer(void);
+static void lrmac_notify_task(TaskHandle_t *ptask);
+static bool lrmac_tx_complete(lrmac_radio_t *radio, bool timeout);
+static bool lrmac_tx_busy(lrmac_radio_t *radio);
+static void lrmac_tx_claim(lrmac_radio_t *radio);
+static bool lrmac_is_dedicated(lrmac_radio_t *radio);
+static lrmac_radio_t *lrmac_least_recent_rx(void);
+static bool lrmac_rx_ranks_before(lrmac_radio_t *a, lrmac_radio_t *b, TickType_t now);
+static bool lrmac_channel_busy(lrmac_radio_t *radio, uint16_t listen_us);
+
+
+
+void lrmac_initialize(TaskHandle_t *pconsumer_task){
+	pconsumer = pconsumer_task;
+
+	if(mac_region == NULL) lrmac_use_region(lrmac_region_get(LRWGW_DEFAULT_REGION));
+
+	for(int i=0; i<LRWGW_PHYS_MAX; i++){
+		lrmac_ring_clear(&mac_radio[i].ring);
+		mac_radio[i].tx_busy = false;
+		memset((void *)&mac_radio[i].turnaround, 0, sizeof(lrmac_turnaround_t));
+		memset((void *)&mac_radio[i].tx_stats, 0, sizeof(lrmac_tx_stats_t));
+	}
+}
 
+/**
+ * Task woken at every TX done, e.g. the downlink scheduler waiting on a busy radio.
+ */
+void lrmac_register_tx_listener(TaskHandle_t *ptask){
+	ptx_listener = ptask;
+}
 
+/**
+ * Switch plan at run time, radios already linked are retuned to the channel
+ * of the same index in the new plan, or stopped when it has no such channel.
+ */
+bool lrmac_select_region(lrmac_region_id_t id){
+	const lrmac_region_t *region = lrmac_region_get(id);
+	if(region == NULL) return false;
+
+	lrmac_use_region(region);
+	memset((void *)mac_channel_radio, 0, sizeof(mac_channel_radio));
+
+	for(int i=0; i<LRWGW_PHYS_MAX; i++){
+		lrmac_radio_t *radio = &mac_radio[i];
+		if(radio->phys == NULL) continue;
+
+		if(radio->channel >= mac_region->channel_count){
+			LOG_WARN(TAG, "Region %s has no channel %d, radio stopped", mac_region->name, radio->channel);
+			radio->phys->idle();
+			continue;
+		}
+		lrmac_bind_radio(radio);
+		lrmac_restore_default_setting(radio->channel);
+	}
 
-void lrmac_get_phys_info(uint8_t channel, lrmac_phys_info_t *info){
-	if(channel < 0) channel = 0;
-	if(channel > 7) channel = 7;
+#if LRWGW_MAC_DEBUG
+	LOG_INFO(TAG, "Region plan %s, %d channels", mac_region->name, mac_region->channel_count);
+#endif
 
-	info->phys = phys_corresponds_channel[channel];
-	info->freq = phys_channel_freq_table[channel];
-	info->bw   = phys_channel_bw_table[channel];
-	info->sf   = phys_channel_sf_table[channel];
-	info->cdr  = phys_channel_cdr_table[channel];
-	info->rssi = (double)info->phys->packet_rssi();
-	info->snr  = (int8_t)info->phys->packet_snr();
+	return true;
 }
 
+const lrmac_region_t *lrmac_get_region(void){
+	if(mac_region == NULL) lrmac_use_region(lrmac_region_get(LRWGW_DEFAULT_REGION));
 
-void lrmac_initialize(QueueHandle_t *pqueue_macpkt){
-	pqueue = pqueue_macpkt;
-
-	for(int i=0; i<8; i++){
-		phys_settings_table[i].freq = phys_channel_freq_table[i];
-		phys_settings_table[i].powe = 20;
-		phys_settings_table[i].sf   = phys_channel_sf_table[i];
-		phys_settings_table[i].bw   = phys_channel_bw_table[i];
-		phys_settings_table[i].codr = phys_channel_cdr_table[i];
-		phys_settings_table[i].prea = 8;
-		phys_settings_table[i].crc  = false;
-		phys_settings_table[i].iiq  = false;
-	}
+	return mac_region;
 }
 
 bool lrmac_link_physical(lrphys *phys, lrphys_hwconfig_t *hwconf, uint8_t channel){
-	if(channel < 0) channel = 0;
-	if(channel > 7) channel = 7;
-	phys_corresponds_channel[channel] = phys;
+	lrmac_radio_t *radio = NULL;
+
+	if(mac_region == NULL) lrmac_use_region(lrmac_region_get(LRWGW_DEFAULT_REGION));
+	if(channel >= mac_region->channel_count){
+		LOG_ERROR(TAG, "Region %s has no channel %d", mac_region->name, channel);
+		return false;
+	}
+	if(mac_channel_radio[channel] != NULL && mac_channel_radio[channel]->phys != phys){
+		LOG_ERROR(TAG, "Channel %d already has a LoRa physical", channel);
+		return false;
+	}
+
+	/**
+	 * Relinking the same radio reuses its slot.
+	 */
+	for(int i=0; i<LRWGW_PHYS_MAX && radio == NULL; i++){
+		if(mac_radio[i].phys == phys) radio = &mac_radio[i];
+	}
+	for(int i=0; i<LRWGW_PHYS_MAX && radio == NULL; i++){
+		if(mac_radio[i].phys == NULL) radio = &mac_radio[i];
+	}
+	if(radio == NULL){
+		LOG_ERROR(TAG, "No free radio slot, raise LRWGW_PHYS_MAX");
+		return false;
+	}
+
+	/**
+	 * Ring storage is taken once per radio and kept across relinks.
+	 */
+	if(radio->ring.entry == NULL){
+		lrmac_ring_entry_t *entry = (lrmac_ring_entry_t *)pvPortMalloc(LRWGW_RX_RING_DEPTH * sizeof(lrmac_ring_entry_t));
+		if(!lrmac_ring_attach(&radio->ring, entry, LRWGW_RX_RING_DEPTH)){
+			LOG_ERROR(TAG, "Fail to allocate RX ring of channel %d", channel);
+			if(entry != NULL) vPortFree(entry);
+			return false;
+		}
+	}
+
+	if(radio->phys != NULL && mac_channel_radio[radio->channel] == radio)
+		mac_channel_radio[radio->channel] = NULL;
+	radio->phys = phys;
+	radio->channel = channel;
 
 	if(!phys->initialize(hwconf)) {
 		LOG_ERROR(TAG, "Fail to initialize LoRa physical channel %d", channel);
+		radio->phys = NULL;
 		return false;
 	}
-	phys->register_event_handler(lrmac_phys_event_handler, (void *)phys);
+	phys->register_event_handler(lrmac_phys_event_handler, (void *)radio);
 
+	lrmac_bind_radio(radio);
 	lrmac_restore_default_setting(channel);
 
-	phys->set_mode_receive_it(0);
-
 #if LRWGW_MAC_DEBUG
-	LOG_INFO(TAG, "Add LoRa physical to channel %d[freq: %luHz, sf: %d, bw: %lu, codr: 4/%d]",
-			channel, phys_channel_freq_table[channel], phys_channel_sf_table[channel], phys_channel_bw_table[channel], phys_channel_cdr_table[channel]);
+	const lrmac_region_channel_t *plan = &mac_region->channel[channel];
+	LOG_INFO(TAG, "Add LoRa physical to %s channel %d[freq: %luHz, sf: %d, bw: %lu, codr: 4/%d]",
+			mac_region->name, channel, plan->freq, plan->sf, plan->bw, plan->cdr);
 #endif
 
 	return true;
 }
 
 void lrmac_suspend_physical(void){
-	for(int i=0; i<8; i++){
-		if(phys_corresponds_channel[i] != NULL)
-			phys_corresponds_channel[i]->stop();
+	for(int i=0; i<LRWGW_PHYS_MAX; i++){
+		if(mac_radio[i].phys != NULL)
+			mac_radio[i].phys->stop();
 	}
 }
 
-void lrmac_send_packet(lrmac_packet_t *pkt){
-	lrphys *phys = phys_corresponds_channel[pkt->channel];
+bool lrmac_send_packet(lrmac_packet_t *pkt, bool at_tmst){
+	lrmac_radio_t *radio = lrmac_get_radio(pkt->channel);
+	if(radio == NULL){
+		LOG_ERROR(TAG, "No LoRa physical on channel %d", pkt->channel);
+		return false;
+	}
+	if(lrmac_tx_busy(radio)){
+		radio->tx_stats.busy++;
+		return false;
+	}
+	lrphys *phys = radio->phys;
+
+	/**
+	 * Held from LBT until TX start, the service task cannot take the FIFO or
+	 * the mode away in between.
+	 */
+	phys->lock();
+	lrmac_tx_claim(radio);
+
+#if LRWGW_LBT
+	if(mac_region->lbt_rssi != 0 && lrmac_channel_busy(radio, mac_region->lbt_us)){
+		radio->tx_stats.lbt_busy++;
+		phys->unlock();
+		return false;
+	}
+#endif
 
 	phys->packet_begin();
 	phys->transmit(pkt->payload, pkt->payload_size);
-	phys->packet_end();
 
-	lrmac_packet_t *evpkt = NULL;
-	evpkt = (lrmac_packet_t *)malloc(sizeof(lrmac_packet_t));
-	if(evpkt == NULL) {
-		LOG_ERROR(TAG, "Memory exhausted, malloc fail at %s -> %d", __FUNCTION__, __LINE__);
-		return;
+	if(radio->apply_cycles != 0){
+		lrmac_turnaround_t *ta = &radio->turnaround;
+		ta->rx_to_tx_us = lrmac_cycles_to_us(DWT->CYCCNT - radio->apply_cycles);
+		if(ta->rx_to_tx_us > ta->rx_to_tx_us_max) ta->rx_to_tx_us_max = ta->rx_to_tx_us;
+		radio->apply_cycles = 0;
 	}
-	memset((void *)evpkt, 0, sizeof(lrmac_packet_t));
-	evpkt->channel = pkt->channel;
-	evpkt->payload_size = 0;
-	evpkt->payload = NULL;
-	evpkt->eventid = LRPHYS_TRANSMIT_COMPLETED;
 
-	BaseType_t ret = (xPortIsInsideInterrupt())? xQueueSendFromISR(*pqueue, &evpkt, NULL) : xQueueSend(*pqueue, &evpkt, 10);
-	if(ret != pdTRUE)
-		LOG_ERROR(TAG, "Error queue full at %s -> %d", __FUNCTION__, __LINE__);
+	if(at_tmst) lrmac_timer_wait(pkt->meta.tmst);
 
-	phys->set_mode_receive_it(0);
+	radio->tx_stats.airtime_us = lrphys_airtime_us(pkt->payload_size, radio->tx_sf, radio->tx_bw,
+			radio->tx_cdr, radio->tx_prea, radio->tx_crc);
+	radio->tx_stats.sent++;
+	radio->tx_cycles = DWT->CYCCNT;
+	radio->tx_tick = xTaskGetTickCount();
+	__atomic_store_n(&radio->tx_busy, true, __ATOMIC_RELEASE);
+
+	/**
+	 * TX done comes back on DIO0 through lrmac_phys_event_handler().
+	 */
+	phys->packet_end(true);
+	phys->unlock();
+
+	return true;
 }
 
+bool lrmac_is_transmitting(uint8_t channel){
+	lrmac_radio_t *radio = lrmac_get_radio(channel);
 
-void lrmac_apply_setting(uint8_t channel, lrmac_phys_setting_t *phys_settings){
-	phys_corresponds_channel[channel]->set_syncword(LRWGW_SYNCWORD);
+	return (radio != NULL)? lrmac_tx_busy(radio) : false;
+}
+
+void lrmac_get_tx_stats(uint8_t channel, lrmac_tx_stats_t *stats){
+	lrmac_radio_t *radio = lrmac_get_radio(channel);
+
+	if(radio != NULL)
+		*stats = radio->tx_stats;
+	else
+		memset((void *)stats, 0, sizeof(lrmac_tx_stats_t));
+}
+
+void lrmac_reset_tx_stats(uint8_t channel){
+	lrmac_radio_t *radio = lrmac_get_radio(channel);
+
+	if(radio != NULL)
+		memset((void *)&radio->tx_stats, 0, sizeof(lrmac_tx_stats_t));
+}
 
-	phys_corresponds_channel[channel]->set_frequency(phys_settings->freq);
-	phys_corresponds_channel[channel]->set_txpower(phys_settings->powe);
-	phys_corresponds_channel[channel]->set_spreadingfactor(phys_settings->sf);
-	phys_corresponds_channel[channel]->set_bandwidth(phys_settings->bw);
-	phys_corresponds_channel[channel]->set_codingrate4(phys_settings->codr);
-	phys_corresponds_channel[channel]->set_preamblelength(phys_settings->prea);
 
-//	(phys_settings->crc)? phys_corresponds_channel[channel]->enable_crc():
-//						  phys_corresponds_channel[channel]->disable_crc();
-//	(phys_settings->iiq)? phys_corresponds_channel[channel]->enable_invertIQ():
-//						  phys_corresponds_channel[channel]->disable_invertIQ();
-	phys_corresponds_channel[channel]->set_mode_receive_it(0);
+void lrmac_apply_setting(uint8_t channel, lrmac_phys_setting_t *phys_settings){
+	lrphys_profile_t profile;
+	lrmac_radio_t *radio = lrmac_get_radio(channel);
+	if(radio == NULL) return;
+	if(lrmac_tx_busy(radio)){
+		LOG_ERROR(TAG, "Channel %d still transmitting, setting not applied", channel);
+		return;
+	}
+	radio->phys->lock();
+	lrmac_tx_claim(radio);
+
+	radio->apply_cycles  = DWT->CYCCNT;
+	radio->txdone_cycles = 0;
+	radio->tx_sf   = phys_settings->sf;
+	radio->tx_bw   = phys_settings->bw;
+	radio->tx_cdr  = phys_settings->codr;
+	radio->tx_prea = phys_settings->prea;
+	radio->tx_crc  = phys_settings->crc;
+
+	/**
+	 * CRC and IQ inversion as the downlink asks, LoRaWAN downlinks go out
+	 * without CRC and inverted. The channel image puts both back at restore.
+	 */
+	lrphys::build_profile(&profile, phys_settings->freq, phys_settings->powe, phys_settings->sf,
+			phys_settings->bw, phys_settings->codr, phys_settings->prea, LRWGW_SYNCWORD,
+			phys_settings->crc, phys_settings->iiq);
+	if(radio->phys->is_cad_scanning())
+		radio->phys->idle();
+	radio->phys->apply_profile(&profile);
+	radio->phys->set_mode_receive_it(0);
+	radio->phys->unlock();
 }
 
 void lrmac_restore_default_setting(uint8_t channel){
-	lrmac_apply_setting(channel, &phys_settings_table[channel]);
+	lrmac_radio_t *radio = lrmac_get_radio(channel);
+	if(radio == NULL) return;
+
+	const lrmac_region_channel_t *plan = &mac_region->channel[radio->channel];
+
+	radio->phys->lock();
+	if(radio->phys->is_cad_scanning())
+		radio->phys->idle();
+	radio->phys->apply_profile(&radio->profile);
+	if(lrmac_is_dedicated(radio))
+		radio->phys->idle();
+	else
+		lrmac_start_receive(radio->phys);
+	radio->tx_claimed = false;
+	radio->phys->unlock();
+
+	radio->tx_sf   = plan->sf;
+	radio->tx_bw   = plan->bw;
+	radio->tx_cdr  = plan->cdr;
+	radio->tx_prea = 8;
+	radio->tx_crc  = true;
+
+	if(radio->txdone_cycles != 0){
+		lrmac_turnaround_t *ta = &radio->turnaround;
+		ta->tx_to_rx_us = lrmac_cycles_to_us(DWT->CYCCNT - radio->txdone_cycles);
+		if(ta->tx_to_rx_us > ta->tx_to_rx_us_max) ta->tx_to_rx_us_max = ta->tx_to_rx_us;
+		ta->count++;
+		radio->txdone_cycles = 0;
+	}
+}
+
+void lrmac_get_turnaround(uint8_t channel, lrmac_turnaround_t *turnaround){
+	lrmac_radio_t *radio = lrmac_get_radio(channel);
+
+	if(radio != NULL)
+		*turnaround = radio->turnaround;
+	else
+		memset((void *)turnaround, 0, sizeof(lrmac_turnaround_t));
 }
 
+lrmac_packet_t *lrmac_next_packet(void){
+	lrmac_packet_t *oldest = NULL;
+
+	/**
+	 * Ring heads are each the oldest of their radio, the smallest tmst among
+	 * them (wrap safe) is the oldest overall.
+	 */
+	for(int i=0; i<LRWGW_PHYS_MAX; i++){
+		lrmac_packet_t *pkt = lrmac_ring_peek(&mac_radio[i].ring);
+
+		if(pkt != NULL && (oldest == NULL || (int32_t)(pkt->meta.tmst - oldest->meta.tmst) < 0))
+			oldest = pkt;
+	}
+
+	return oldest;
+}
+
+void lrmac_release_packet(lrmac_packet_t *pkt){
+	lrmac_radio_t *radio = (pkt != NULL)? lrmac_get_radio(pkt->channel) : NULL;
+
+	if(radio != NULL)
+		lrmac_ring_release(&radio->ring);
+}
+
+void lrmac_get_rx_ring_stats(uint8_t channel, lrmac_ring_stats_t *stats){
+	lrmac_radio_t *radio = lrmac_get_radio(channel);
+
+	if(radio != NULL)
+		*stats = radio->ring.stats;
+	else
+		memset((void *)stats, 0, sizeof(lrmac_ring_stats_t));
+}
+
+void lrmac_reset_rx_ring_stats(uint8_t channel){
+	lrmac_radio_t *radio = lrmac_get_radio(channel);
+	if(radio == NULL) return;
+
+	lrmac_ring_stats_t *stats = &radio->ring.stats;
+	stats->pushed = 0;
+	stats->dropped = 0;
+	stats->high_water = lrmac_ring_count(&radio->ring);
+}
+
+/**
+ * Plan channel of freq, nearest raster step, LRMAC_CHANNEL_NONE when no
+ * channel sits there.
+ */
 uint8_t lrmac_get_channel_by_freq(long freq){
-	uint8_t channel = 0;
+	int16_t index = lrmac_region_raster_index(lrmac_get_region(), freq);
+
+	return (index < 0)? LRMAC_CHANNEL_NONE : mac_raster_channel[index];
+}
 
-	for(;channel<8; channel++){
-		if(freq == phys_channel_freq_table[channel]) break;
+/**
+ * Channel whose radio transmits on freq, chosen by the arbitration mode.
+ * The caller retunes it with lrmac_apply_setting(), the radio returns to its
+ * own channel, or to standby when dedicated, on TX done. No radio is read,
+ * it runs at admission from the reactor.
+ */
+uint8_t lrmac_get_tx_channel(long freq){
+	lrmac_radio_t *radio = NULL;
+
+	switch(mac_tx_arbitration){
+		case LRMAC_TX_ARB_DEDICATED:
+			radio = lrmac_get_radio(mac_tx_dedicated);
+		break;
+		case LRMAC_TX_ARB_CHANNEL:
+			radio = lrmac_get_radio(lrmac_get_channel_by_freq(freq));
+		break;
+		default:
+		break;
+	}
+
+	if(radio == NULL) radio = lrmac_least_recent_rx();
+	if(radio == NULL){
+		LOG_ERROR(TAG, "No LoRa physical to transmit on %luHz", freq);
+		return LRMAC_CHANNEL_NONE;
+	}
+
+	return radio->channel;
+}
+
+/**
+ * Dedicated mode parks tx_channel in standby between downlinks, leaving it
+ * parks the previous transmitter back on its RX channel.
+ */
+bool lrmac_set_tx_arbitration(lrmac_tx_arbitration_t mode, uint8_t tx_channel){
+	lrmac_radio_t *previous = (mac_tx_arbitration == LRMAC_TX_ARB_DEDICATED)? lrmac_get_radio(mac_tx_dedicated) : NULL;
+
+	if(mode == LRMAC_TX_ARB_DEDICATED && lrmac_get_radio(tx_channel) == NULL){
+		LOG_ERROR(TAG, "No LoRa physical on channel %d to dedicate", tx_channel);
+		return false;
+	}
+
+	mac_tx_arbitration = mode;
+	mac_tx_dedicated = tx_channel;
+
+	if(previous != NULL && !lrmac_is_dedicated(previous) && !lrmac_tx_busy(previous))
+		lrmac_restore_default_setting(previous->channel);
+	if(mode == LRMAC_TX_ARB_DEDICATED && !lrmac_tx_busy(lrmac_get_radio(tx_channel)))
+		lrmac_restore_default_setting(tx_channel);
+
+	return true;
+}
+
+lrmac_tx_arbitration_t lrmac_get_tx_arbitration(void){
+	return mac_tx_arbitration;
+}
+
+/**
+ * Channels of the linked radios in lrmac_get_tx_channel() order, at most max
+ * of them, for the reactor to look for another transmitter ahead of time.
+ */
+uint8_t lrmac_get_tx_candidates(uint8_t *channel, uint8_t max){
+	lrmac_radio_t *ranked[LRWGW_PHYS_MAX];
+	uint8_t count = 0;
+	TickType_t now = xTaskGetTickCount();
+
+	for(int i=0; i<LRWGW_PHYS_MAX; i++){
+		lrmac_radio_t *radio = &mac_radio[i];
+		if(radio->phys == NULL || mac_channel_radio[radio->channel] != radio) continue;
+
+		uint8_t at = count++;
+		while(at > 0 && lrmac_rx_ranks_before(radio, ranked[at - 1], now)){
+			ranked[at] = ranked[at - 1];
+			at--;
+		}
+		ranked[at] = radio;
 	}
 
-	return channel;
+	if(count > max) count = max;
+	for(uint8_t i=0; i<count; i++) channel[i] = ranked[i]->channel;
+
+	return count;
 }
 
 
 static void lrmac_phys_event_handler(void *arg, lrphys_eventid_t id, uint8_t len){
-	lrphys *phys = (lrphys *)arg;
+	lrmac_radio_t *radio = (lrmac_radio_t *)arg;
+	lrphys *phys = radio->phys;
 	lrmac_packet_t *pkt = NULL;
+	uint8_t channel = radio->channel;
 
-
-	pkt = (lrmac_packet_t *)malloc(sizeof(lrmac_packet_t));
+	if(id == LRPHYS_TRANSMIT_COMPLETED){
+		/** Already recovered by the TX timeout, nothing left to report */
+		if(!lrmac_tx_complete(radio, false)) return;
+	}
+	else
+		radio->rx_tick = xTaskGetTickCount();
+
+	/**
+	 * Runs from the radio service task or ISR, the frame is read straight
+	 * into this radio's ring, no heap. The service task holds the radio lock.
+	 */
+	pkt = lrmac_ring_reserve(&radio->ring);
 	if(pkt == NULL) {
-		LOG_ERROR(TAG, "Memory exhausted, malloc fail at %s -> %d", __FUNCTION__, __LINE__);
+		LOG_ERROR(TAG, "RX ring of channel %d full at %s -> %d", channel, __FUNCTION__, __LINE__);
 		return;
 	}
-	memset((void *)pkt, 0, sizeof(lrmac_packet_t));
-
-	uint8_t channel = lrmac_get_phys_channel(phys);
 
 	pkt->channel = channel;
 	pkt->payload_size = len;
+	if(id == LRPHYS_TRANSMIT_COMPLETED)
+		pkt->meta.tmst = phys->get_rx_timestamp();
+	else
+		phys->get_rx_meta(&pkt->meta);
 
 	if(id == LRPHYS_RECEIVE_COMPLETED && len > 0){
-		pkt->payload = (uint8_t *)malloc(len+1);
-		phys->receive((char *)pkt->payload);
+		phys->receive((char *)pkt->payload, len);
 		pkt->payload[len] = 0;
 	}
 	else if(id == LRPHYS_ERROR_CRC){
@@ -219,28 +538,186 @@ static void lrmac_phys_event_handler(void *arg, lrphys_eventid_t id, uint8_t len
 	}
 	pkt->eventid = id;
 
-	BaseType_t ret = xQueueSendFromISR(*pqueue, &pkt, NULL);
-	if(ret != pdTRUE)
-		LOG_ERROR(TAG, "Error queue full at %s -> %d", __FUNCTION__, __LINE__);
+	lrmac_ring_commit(&radio->ring);
+	lrmac_notify_consumer();
+}
+
+static void lrmac_start_receive(lrphys *phys){
+#if LRWGW_RX_CAD_SCAN
+	phys->set_mode_cad_scan(LRWGW_CAD_SF_MIN, LRWGW_CAD_SF_MAX);
+#else
+	phys->set_mode_receive_it(0);
+#endif
+}
+
+static void lrmac_notify_consumer(void){
+	lrmac_notify_task(pconsumer);
+}
+
+static void lrmac_notify_task(TaskHandle_t *ptask){
+	if(ptask == NULL || *ptask == NULL) return;
+
+	if(xPortIsInsideInterrupt())
+		xTaskNotifyFromISR(*ptask, LRMAC_NOTIFY_PACKET, eSetBits, NULL);
+	else
+		xTaskNotify(*ptask, LRMAC_NOTIFY_PACKET, eSetBits);
+}
+
+/**
+ * Back to the channel RX setting, from the radio event context at TX done or
+ * from the sender when TX done never came. False when the other one already
+ * completed this TX.
+ */
+static bool lrmac_tx_complete(lrmac_radio_t *radio, bool timeout){
+	uint32_t now = DWT->CYCCNT;
+
+	/**
+	 * TX done from the service task and the timeout seen by any other task
+	 * race for the same TX, the exchange lets exactly one through and the
+	 * radio lock keeps its recovery apart from the next downlink.
+	 */
+	radio->phys->lock();
+	if(!__atomic_exchange_n(&radio->tx_busy, false, __ATOMIC_ACQ_REL)){
+		radio->phys->unlock();
+		return false;
+	}
+
+	if(timeout){
+		radio->tx_stats.timeouts++;
+		radio->phys->idle();
+	}
+	else{
+		radio->tx_stats.completed++;
+		radio->tx_stats.tx_us = lrmac_cycles_to_us(now - radio->tx_cycles);
+		if(radio->tx_stats.tx_us > radio->tx_stats.tx_us_max) radio->tx_stats.tx_us_max = radio->tx_stats.tx_us;
+	}
+	if(!lrmac_is_dedicated(radio))
+		radio->tx_stats.blanked_us += lrmac_cycles_to_us(now - radio->tx_cycles);
+
+	radio->txdone_cycles = now;
+	lrmac_restore_default_setting(radio->channel);
+	radio->phys->unlock();
+
+	lrmac_notify_task(ptx_listener);
+
+	return true;
+}
+
+/**
+ * Busy until TX done, or until twice the time on air plus a margin has gone
+ * by, the radio is then recovered as if TX done had come.
+ */
+static bool lrmac_tx_busy(lrmac_radio_t *radio){
+	if(!__atomic_load_n(&radio->tx_busy, __ATOMIC_ACQUIRE)) return false;
+
+	TickType_t limit = pdMS_TO_TICKS(2 * radio->tx_stats.airtime_us / 1000U + LRMAC_TX_TIMEOUT_MARGIN_MS);
+	if(xTaskGetTickCount() - radio->tx_tick < limit) return true;
+
+	LOG_ERROR(TAG, "Channel %d TX done missing, recovered", radio->channel);
+	lrmac_tx_complete(radio, true);
+
+	return false;
+}
+
+static lrmac_radio_t *lrmac_get_radio(uint8_t channel){
+	if(channel >= LRMAC_REGION_CHANNEL_MAX) return NULL;
+
+	return mac_channel_radio[channel];
 }
 
-static uint8_t lrmac_get_phys_channel(lrphys *phys){
-	uint8_t channel = 0;
+/**
+ * Map the radio to its plan channel and precompute the channel RX image,
+ * restoring after a downlink only writes what the downlink changed.
+ */
+static void lrmac_bind_radio(lrmac_radio_t *radio){
+	const lrmac_region_channel_t *plan = &mac_region->channel[radio->channel];
 
-	for(;channel<8; channel++){
-		if(phys == phys_corresponds_channel[channel]) break;
+	mac_channel_radio[radio->channel] = radio;
+	lrphys::build_profile(&radio->profile, plan->freq, mac_region->power_max,
+			plan->sf, plan->bw, plan->cdr, 8, LRWGW_SYNCWORD);
+}
+
+/**
+ * Make region current and index its channels by raster step.
+ */
+static void lrmac_use_region(const lrmac_region_t *region){
+	mac_region = region;
+	lrmac_duty_use_region(region);
+	memset((void *)mac_raster_channel, LRMAC_CHANNEL_NONE, sizeof(mac_raster_channel));
+
+	for(uint8_t i=0; i<region->channel_count; i++){
+		long freq = region->channel[i].freq;
+		int16_t index = lrmac_region_raster_index(region, freq);
+
+		if(index < 0 || (freq - region->raster_base) % region->raster_step != 0){
+			LOG_ERROR(TAG, "Region %s channel %d at %luHz is off raster", region->name, i, freq);
+			continue;
+		}
+		mac_raster_channel[index] = i;
 	}
+}
+
+/**
+ * First touch of a downlink on the radio, a frame being demodulated there is lost.
+ */
+static void lrmac_tx_claim(lrmac_radio_t *radio){
+	if(radio->tx_claimed) return;
+
+	radio->tx_claimed = true;
+	if(!lrmac_is_dedicated(radio) && radio->phys->is_receiving())
+		radio->tx_stats.rx_aborted++;
+}
 
-	return channel;
+static bool lrmac_is_dedicated(lrmac_radio_t *radio){
+	return mac_tx_arbitration == LRMAC_TX_ARB_DEDICATED && lrmac_get_radio(mac_tx_dedicated) == radio;
 }
 
+/**
+ * Linked radio best left to transmit, by lrmac_rx_ranks_before().
+ */
+static lrmac_radio_t *lrmac_least_recent_rx(void){
+	lrmac_radio_t *best = NULL;
+	TickType_t now = xTaskGetTickCount();
 
+	for(int i=0; i<LRWGW_PHYS_MAX; i++){
+		lrmac_radio_t *radio = &mac_radio[i];
+		if(radio->phys == NULL || mac_channel_radio[radio->channel] != radio) continue;
 
+		if(best == NULL || lrmac_rx_ranks_before(radio, best, now)) best = radio;
+	}
 
+	return best;
+}
 
+/**
+ * a better left to transmit than b: not transmitting, not locked on a frame,
+ * then the one whose last frame is oldest, so the busiest channels keep
+ * listening. Ranked from RAM only, the arbitration runs at admission from
+ * the reactor; lrmac_tx_claim() reads the modem status at TX time.
+ */
+static bool lrmac_rx_ranks_before(lrmac_radio_t *a, lrmac_radio_t *b, TickType_t now){
+	uint8_t rank_a = (__atomic_load_n(&a->tx_busy, __ATOMIC_ACQUIRE)? 2 : 0) + (a->phys->is_rx_locked()? 1 : 0);
+	uint8_t rank_b = (__atomic_load_n(&b->tx_busy, __ATOMIC_ACQUIRE)? 2 : 0) + (b->phys->is_rx_locked()? 1 : 0);
 
+	if(rank_a != rank_b) return rank_a < rank_b;
 
+	return now - a->rx_tick > now - b->rx_tick;
+}
 
+/**
+ * Sample RSSI for listen_us (at least once), busy as soon as a sample reaches
+ * the region threshold. The radio has to be in RX on the frequency to check.
+ */
+static bool lrmac_channel_busy(lrmac_radio_t *radio, uint16_t listen_us){
+	uint32_t start = DWT->CYCCNT;
 
+	do{
+		if(radio->phys->rssi() >= mac_region->lbt_rssi) return true;
+	} while(lrmac_cycles_to_us(DWT->CYCCNT - start) < listen_us);
 
+	return false;
+}
 
+static uint32_t lrmac_cycles_to_us(uint32_t cycles){
+	return cycles / (SystemCoreClock / 1000000U);
+}
@@ -13,14 +13,27 @@ extern "C"{
 #endif
 
 #include "lorawan/lrphys/lrphys.h"
+#include "lorawan/lrmac/lrmac_region.h"
 #include "FreeRTOS.h"
-#include "queue.h"
+#include "task.h"
+
+#define LRMAC_CHANNEL_NONE 0xff
+
+/**
+ * How lrmac_get_tx_channel() picks the radio of a downlink.
+ */
+typedef enum{
+	LRMAC_TX_ARB_CHANNEL,        /** Radio serving the downlink channel, least recent RX when none */
+	LRMAC_TX_ARB_LEAST_RECENT_RX, /** Idle radio that received least recently */
+	LRMAC_TX_ARB_DEDICATED,      /** One radio transmits everything and never receives */
+} lrmac_tx_arbitration_t;
 
 typedef struct{
 	uint8_t          channel      = 0;
 	lrphys_eventid_t eventid      = LRPHYS_ERROR_CRC;
 	uint8_t          *payload     = NULL;
 	uint8_t          payload_size = 0;
+	lrphys_rx_meta_t meta         = {0, 0, 0, 0, 0, 0, 0, 0, 0};
 } lrmac_packet_t;
 
 typedef struct{
@@ -34,28 +47,84 @@ typedef struct{
 	bool iiq;
 } lrmac_phys_setting_t;
 
+typedef struct{
+	uint32_t count;
+	uint32_t rx_to_tx_us;     /** Apply setting until TX start */
+	uint32_t rx_to_tx_us_max;
+	uint32_t tx_to_rx_us;     /** TX done until RX restored */
+	uint32_t tx_to_rx_us_max;
+} lrmac_turnaround_t;
 
 typedef struct{
-	lrphys *phys;
-	long freq;
-	long bw;
-	uint8_t sf;
-	uint8_t cdr;
-	int8_t rssi;
-	int8_t snr;
-} lrmac_phys_info_t;
+	uint32_t pushed;
+	uint32_t dropped;    /** Ring full, frame left in the radio FIFO */
+	uint16_t high_water; /** Most entries ever waiting */
+	uint16_t depth;
+} lrmac_ring_stats_t;
+
+typedef struct{
+	uint32_t sent;
+	uint32_t completed;
+	uint32_t busy;       /** Refused, radio still transmitting */
+	uint32_t timeouts;   /** TX done never signalled, radio recovered */
+	uint32_t airtime_us; /** Last frame, computed time on air */
+	uint32_t tx_us;      /** Last frame, TX start until TX done interrupt */
+	uint32_t tx_us_max;
+	uint32_t rx_aborted; /** Uplinks lost, radio was mid frame when taken for TX */
+	uint32_t blanked_us; /** Listening time lost to TX on this radio */
+	uint32_t lbt_busy;   /** Downlinks refused by listen before talk */
+} lrmac_tx_stats_t;
 
-void lrmac_initialize(QueueHandle_t *pqueue_macpkt);
+/**
+ * Set in the notification value of the consumer and TX listener tasks, other
+ * bits are left to them. ulTaskNotifyTake() sees it as a count.
+ */
+#define LRMAC_NOTIFY_PACKET (1UL << 0)
+
+void lrmac_initialize(TaskHandle_t *pconsumer_task);
+void lrmac_register_tx_listener(TaskHandle_t *ptask);
+bool lrmac_select_region(lrmac_region_id_t id);
+const lrmac_region_t *lrmac_get_region(void);
+
+/**
+ * channel is the plan channel the radio receives on, every channel argument
+ * below refers to the same plan channel.
+ */
 bool lrmac_link_physical(lrphys *phys, lrphys_hwconfig_t *hwconf, uint8_t channel = 0);
 void lrmac_suspend_physical(void);
 
-void lrmac_get_phys_info(uint8_t channel, lrmac_phys_info_t *info);
 uint8_t lrmac_get_channel_by_freq(long freq);
+uint8_t lrmac_get_tx_channel(long freq);
+bool lrmac_set_tx_arbitration(lrmac_tx_arbitration_t mode, uint8_t tx_channel = 0);
+lrmac_tx_arbitration_t lrmac_get_tx_arbitration(void);
+uint8_t lrmac_get_tx_candidates(uint8_t *channel, uint8_t max);
 
 void lrmac_apply_setting(uint8_t channel, lrmac_phys_setting_t *phys_settings);
 void lrmac_restore_default_setting(uint8_t channel);
+void lrmac_get_turnaround(uint8_t channel, lrmac_turnaround_t *turnaround);
+
+/**
+ * Starts the transmission and returns, TX done restores the channel RX
+ * setting, queues a LRPHYS_TRANSMIT_COMPLETED packet and wakes the TX
+ * listener. false when the radio is still transmitting or absent.
+ * With at_tmst the frame is loaded first and the TX started when the
+ * lrmac_timer counter reaches pkt->meta.tmst.
+ */
+bool lrmac_send_packet(lrmac_packet_t *pkt, bool at_tmst = false);
+bool lrmac_is_transmitting(uint8_t channel);
+void lrmac_get_tx_stats(uint8_t channel, lrmac_tx_stats_t *stats);
+void lrmac_reset_tx_stats(uint8_t channel);
+
+/**
+ * Consumer side of the per-radio RX rings, forward task only.
+ * Returns the oldest event by tmst across all radios, NULL when everything
+ * is drained. The packet stays valid until lrmac_release_packet().
+ */
+lrmac_packet_t *lrmac_next_packet(void);
+void lrmac_release_packet(lrmac_packet_t *pkt);
 
-void lrmac_send_packet(lrmac_packet_t *pkt);
+void lrmac_get_rx_ring_stats(uint8_t channel, lrmac_ring_stats_t *stats);
+void lrmac_reset_rx_ring_stats(uint8_t channel);
 
 
 #ifdef __cplusplus
@@ -0,0 +1,157 @@
+/*
+ * lrmac_duty.cpp
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: anh
+ */
+
+#include "lorawan/gateway/gateway_config.h"
+#include "lorawan/lrmac/lrmac_duty.h"
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "string.h"
+
+
+#define LRMAC_DUTY_BUCKET_TICKS pdMS_TO_TICKS(LRWGW_DUTY_WINDOW_S * 1000U / LRMAC_DUTY_BUCKETS)
+
+/**
+ * A bucket counts while its epoch (tick / bucket length) is within the last
+ * LRMAC_DUTY_BUCKETS epochs, stale buckets are reset when reused.
+ */
+typedef struct{
+	uint32_t bucket_us[LRMAC_DUTY_BUCKETS];
+	uint32_t bucket_epoch[LRMAC_DUTY_BUCKETS];
+	uint32_t admitted;
+	uint32_t rejected;
+} lrmac_duty_subband_t;
+
+static lrmac_duty_subband_t duty_subband[LRMAC_REGION_SUBBAND_MAX];
+static const lrmac_region_t *duty_region = NULL;
+
+static_assert(LRWGW_DUTY_WINDOW_S * 1000U / LRMAC_DUTY_BUCKETS > 0, "Duty cycle window shorter than its buckets");
+
+static int8_t lrmac_duty_subband(long freq);
+static uint32_t lrmac_duty_epoch(void);
+static uint32_t lrmac_duty_used(lrmac_duty_subband_t *ledger, uint32_t epoch);
+static uint32_t lrmac_duty_limit(uint8_t subband);
+
+
+
+/**
+ * Start an empty ledger for the sub-bands of region.
+ */
+void lrmac_duty_use_region(const lrmac_region_t *region){
+	taskENTER_CRITICAL();
+	duty_region = region;
+	memset((void *)duty_subband, 0, sizeof(duty_subband));
+	taskEXIT_CRITICAL();
+}
+
+/**
+ * Charge airtime_us to the sub-band of freq, false without charging when the
+ * window would go over the sub-band limit. Frequencies outside every sub-band
+ * are left to the band check, without LRWGW_DUTY_CYCLE airtime is only counted.
+ */
+bool lrmac_duty_reserve(long freq, uint32_t airtime_us){
+	int8_t subband = lrmac_duty_subband(freq);
+	if(subband < 0) return true;
+
+	lrmac_duty_subband_t *ledger = &duty_subband[subband];
+	uint32_t limit = lrmac_duty_limit(subband);
+	uint32_t epoch = lrmac_duty_epoch();
+	bool admit = true;
+
+	taskENTER_CRITICAL();
+	if(LRWGW_DUTY_CYCLE && limit != 0 && lrmac_duty_used(ledger, epoch) + airtime_us > limit){
+		ledger->rejected++;
+		admit = false;
+	}
+	else{
+		uint8_t index = epoch % LRMAC_DUTY_BUCKETS;
+		if(ledger->bucket_epoch[index] != epoch){
+			ledger->bucket_epoch[index] = epoch;
+			ledger->bucket_us[index] = 0;
+		}
+		ledger->bucket_us[index] += airtime_us;
+		ledger->admitted++;
+	}
+	taskEXIT_CRITICAL();
+
+	return admit;
+}
+
+/**
+ * Give back the airtime of a downlink that never went out, newest bucket first.
+ */
+void lrmac_duty_refund(long freq, uint32_t airtime_us){
+	int8_t subband = lrmac_duty_subband(freq);
+	if(subband < 0) return;
+
+	lrmac_duty_subband_t *ledger = &duty_subband[subband];
+	uint32_t epoch = lrmac_duty_epoch();
+
+	taskENTER_CRITICAL();
+	for(uint8_t age=0; age<LRMAC_DUTY_BUCKETS && airtime_us > 0; age++){
+		uint8_t index = (epoch - age) % LRMAC_DUTY_BUCKETS;
+		if(ledger->bucket_epoch[index] != epoch - age) continue;
+
+		uint32_t take = (ledger->bucket_us[index] < airtime_us)? ledger->bucket_us[index] : airtime_us;
+		ledger->bucket_us[index] -= take;
+		airtime_us -= take;
+	}
+	taskEXIT_CRITICAL();
+}
+
+void lrmac_duty_get_stats(uint8_t subband, lrmac_duty_stats_t *stats){
+	memset((void *)stats, 0, sizeof(lrmac_duty_stats_t));
+	if(duty_region == NULL || subband >= duty_region->subband_count) return;
+
+	lrmac_duty_subband_t *ledger = &duty_subband[subband];
+	uint32_t epoch = lrmac_duty_epoch();
+
+	taskENTER_CRITICAL();
+	stats->used_us  = lrmac_duty_used(ledger, epoch);
+	stats->admitted = ledger->admitted;
+	stats->rejected = ledger->rejected;
+	taskEXIT_CRITICAL();
+	stats->limit_us = lrmac_duty_limit(subband);
+}
+
+/**
+ * Counters only, the airtime in the window still applies.
+ */
+void lrmac_duty_reset_stats(void){
+	taskENTER_CRITICAL();
+	for(int i=0; i<LRMAC_REGION_SUBBAND_MAX; i++){
+		duty_subband[i].admitted = 0;
+		duty_subband[i].rejected = 0;
+	}
+	taskEXIT_CRITICAL();
+}
+
+
+static int8_t lrmac_duty_subband(long freq){
+	if(duty_region == NULL) return -1;
+
+	return lrmac_region_subband_index(duty_region, freq);
+}
+
+static uint32_t lrmac_duty_epoch(void){
+	return xTaskGetTickCount() / LRMAC_DUTY_BUCKET_TICKS;
+}
+
+static uint32_t lrmac_duty_used(lrmac_duty_subband_t *ledger, uint32_t epoch){
+	uint32_t used = 0;
+
+	for(uint8_t i=0; i<LRMAC_DUTY_BUCKETS; i++){
+		if(epoch - ledger->bucket_epoch[i] < LRMAC_DUTY_BUCKETS) used += ledger->bucket_us[i];
+	}
+
+	return used;
+}
+
+static uint32_t lrmac_duty_limit(uint8_t subband){
+	return (uint32_t)((uint64_t)LRWGW_DUTY_WINDOW_S * 1000U * duty_region->subband[subband].duty_permille);
+}
@@ -0,0 +1,48 @@
+/*
+ * lrmac_duty.h
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: anh
+ */
+
+#ifndef LORAWAN_LRMAC_LRMAC_DUTY_H_
+#define LORAWAN_LRMAC_LRMAC_DUTY_H_
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+#include "lorawan/lrmac/lrmac_region.h"
+
+
+/**
+ * Group: Duty cycle ledger.
+ * Transmit airtime per sub-band over a sliding window, kept in
+ * LRMAC_DUTY_BUCKETS buckets so the window slides one bucket at a time.
+ */
+#define LRMAC_DUTY_BUCKETS 60
+
+typedef struct{
+	uint32_t used_us;  /** Airtime charged over the current window */
+	uint32_t limit_us; /** Airtime the window allows, 0 unlimited */
+	uint32_t admitted;
+	uint32_t rejected; /** Downlinks refused, over the limit */
+} lrmac_duty_stats_t;
+
+/**
+ * Downlinks are charged when admitted, before they are scheduled, and
+ * refunded when they never reach the air. Task context only.
+ */
+void lrmac_duty_use_region(const lrmac_region_t *region);
+bool lrmac_duty_reserve(long freq, uint32_t airtime_us);
+void lrmac_duty_refund(long freq, uint32_t airtime_us);
+
+void lrmac_duty_get_stats(uint8_t subband, lrmac_duty_stats_t *stats);
+void lrmac_duty_reset_stats(void);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LORAWAN_LRMAC_LRMAC_DUTY_H_ */
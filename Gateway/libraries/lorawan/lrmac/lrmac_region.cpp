@@ -0,0 +1,159 @@
+/*
+ * lrmac_region.cpp
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: anh
+ */
+
+#include "lorawan/lrmac/lrmac_region.h"
+
+#include "string.h"
+
+
+#define LRMAC_REGION_COUNT_OF(table) (sizeof(table) / sizeof((table)[0]))
+#define LRMAC_REGION_AS923_LBT_US    5000U /** ARIB STD-T108 carrier sense time */
+
+
+
+/**
+ * AS923, the channels this gateway has always listened on.
+ */
+static const lrmac_region_channel_t region_as923_channel[] = {
+	{(long)9232E5L, 10, (long)125E3, 5},
+	{(long)9234E5L, 10, (long)125E3, 5},
+	{(long)9236E5L, 10, (long)125E3, 5},
+	{(long)9238E5L, 10, (long)125E3, 5},
+	{(long)9240E5L, 10, (long)125E3, 5},
+	{(long)9242E5L, 10, (long)125E3, 5},
+	{(long)9244E5L, 10, (long)125E3, 5},
+	{(long)9246E5L, 10, (long)125E3, 5},
+};
+
+/**
+ * EU433, the three mandatory channels then the usual network additions.
+ */
+static const lrmac_region_channel_t region_eu433_channel[] = {
+	{(long)433175E3L, 10, (long)125E3, 5},
+	{(long)433375E3L, 10, (long)125E3, 5},
+	{(long)433575E3L, 10, (long)125E3, 5},
+	{(long)433775E3L, 10, (long)125E3, 5},
+	{(long)433975E3L, 10, (long)125E3, 5},
+	{(long)434175E3L, 10, (long)125E3, 5},
+	{(long)434375E3L, 10, (long)125E3, 5},
+	{(long)434575E3L, 10, (long)125E3, 5},
+};
+
+/**
+ * AU915 sub-band 2 (uplink channels 8..15).
+ */
+static const lrmac_region_channel_t region_au915_channel[] = {
+	{(long)9168E5L, 10, (long)125E3, 5},
+	{(long)9170E5L, 10, (long)125E3, 5},
+	{(long)9172E5L, 10, (long)125E3, 5},
+	{(long)9174E5L, 10, (long)125E3, 5},
+	{(long)9176E5L, 10, (long)125E3, 5},
+	{(long)9178E5L, 10, (long)125E3, 5},
+	{(long)9180E5L, 10, (long)125E3, 5},
+	{(long)9182E5L, 10, (long)125E3, 5},
+};
+
+/**
+ * AS923 as one sub-band at 1 %, with the LBT of the countries that require it
+ * (-80 dBm for 5 ms).
+ */
+static const lrmac_region_subband_t region_as923_subband[] = {
+	{(long)915E6L,   (long)928E6L,   10},
+};
+
+/**
+ * EU433, ETSI band 433.05 - 434.79 MHz at 10 %.
+ */
+static const lrmac_region_subband_t region_eu433_subband[] = {
+	{(long)43305E4L, (long)43479E4L, 100},
+};
+
+/**
+ * AU915 has no duty cycle limit, the entry only names the band.
+ */
+static const lrmac_region_subband_t region_au915_subband[] = {
+	{(long)915E6L,   (long)928E6L,   0},
+};
+
+/**
+ * Power limits are clipped to what the SX1276 PA_BOOST output can do.
+ */
+static const lrmac_region_t region_table[LRMAC_REGION_COUNT] = {
+	{LRMAC_REGION_AS923, "AS923", (long)915E6L,   (long)928E6L,   2, 16, (long)9232E5L,   (long)200E3L,
+			LRMAC_REGION_COUNT_OF(region_as923_channel), region_as923_channel,
+			LRMAC_REGION_COUNT_OF(region_as923_subband), region_as923_subband, -80, LRMAC_REGION_AS923_LBT_US},
+	{LRMAC_REGION_EU433, "EU433", (long)43305E4L, (long)43479E4L, 2, 12, (long)433175E3L, (long)200E3L,
+			LRMAC_REGION_COUNT_OF(region_eu433_channel), region_eu433_channel,
+			LRMAC_REGION_COUNT_OF(region_eu433_subband), region_eu433_subband, 0, 0},
+	{LRMAC_REGION_AU915, "AU915", (long)915E6L,   (long)928E6L,   2, 20, (long)9168E5L,   (long)200E3L,
+			LRMAC_REGION_COUNT_OF(region_au915_channel), region_au915_channel,
+			LRMAC_REGION_COUNT_OF(region_au915_subband), region_au915_subband, 0, 0},
+};
+
+static_assert(LRMAC_REGION_COUNT_OF(region_as923_channel) <= LRMAC_REGION_CHANNEL_MAX, "AS923 channel table too large");
+static_assert(LRMAC_REGION_COUNT_OF(region_eu433_channel) <= LRMAC_REGION_CHANNEL_MAX, "EU433 channel table too large");
+static_assert(LRMAC_REGION_COUNT_OF(region_au915_channel) <= LRMAC_REGION_CHANNEL_MAX, "AU915 channel table too large");
+static_assert(LRMAC_REGION_COUNT_OF(region_as923_subband) <= LRMAC_REGION_SUBBAND_MAX, "AS923 sub-band table too large");
+static_assert(LRMAC_REGION_COUNT_OF(region_eu433_subband) <= LRMAC_REGION_SUBBAND_MAX, "EU433 sub-band table too large");
+static_assert(LRMAC_REGION_COUNT_OF(region_au915_subband) <= LRMAC_REGION_SUBBAND_MAX, "AU915 sub-band table too large");
+static_assert(LRMAC_REGION_AS923_LBT_US <= LRMAC_REGION_LBT_US_MAX, "AS923 listen before talk longer than LRMAC_REGION_LBT_US_MAX");
+
+
+
+const lrmac_region_t *lrmac_region_get(lrmac_region_id_t id){
+	if(id >= LRMAC_REGION_COUNT) return NULL;
+
+	return &region_table[id];
+}
+
+const lrmac_region_t *lrmac_region_find(const char *name){
+	if(name == NULL) return NULL;
+
+	for(int i=0; i<LRMAC_REGION_COUNT; i++){
+		if(strcmp(region_table[i].name, name) == 0) return &region_table[i];
+	}
+
+	return NULL;
+}
+
+/**
+ * Server frequencies are MHz doubles, 923.2 * 1E6 truncates to 923199999.
+ */
+long lrmac_region_freq_hz(double mhz){
+	return (long)(mhz * 1E6 + 0.5);
+}
+
+/**
+ * Nearest raster step of freq, -1 outside the raster.
+ */
+int16_t lrmac_region_raster_index(const lrmac_region_t *region, long freq){
+	long offset = freq - region->raster_base + region->raster_step / 2;
+
+	if(offset < 0) return -1;
+	offset /= region->raster_step;
+
+	return (offset < LRMAC_REGION_RASTER_SIZE)? (int16_t)offset : -1;
+}
+
+/**
+ * Sub-band holding freq, -1 when none does.
+ */
+int8_t lrmac_region_subband_index(const lrmac_region_t *region, long freq){
+	for(uint8_t i=0; i<region->subband_count; i++){
+		if(freq >= region->subband[i].freq_min && freq <= region->subband[i].freq_max) return (int8_t)i;
+	}
+
+	return -1;
+}
+
+bool lrmac_region_check_freq(const lrmac_region_t *region, long freq){
+	return freq >= region->freq_min && freq <= region->freq_max;
+}
+
+bool lrmac_region_check_power(const lrmac_region_t *region, int8_t power){
+	return power >= region->power_min && power <= region->power_max;
+}
@@ -0,0 +1,89 @@
+/*
+ * lrmac_region.h
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: anh
+ */
+
+#ifndef LORAWAN_LRMAC_LRMAC_REGION_H_
+#define LORAWAN_LRMAC_LRMAC_REGION_H_
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+#include "stdint.h"
+#include "stdbool.h"
+
+
+/**
+ * Group: Region plan.
+ * Largest channel table of any plan, sizes the channel to radio map.
+ */
+#define LRMAC_REGION_CHANNEL_MAX 16
+#define LRMAC_REGION_RASTER_SIZE 128  /** Raster steps indexed from raster_base */
+#define LRMAC_REGION_SUBBAND_MAX 4
+#define LRMAC_REGION_LBT_US_MAX  5000U /** Longest listen before talk time of any plan */
+
+typedef enum{
+	LRMAC_REGION_AS923,
+	LRMAC_REGION_EU433,
+	LRMAC_REGION_AU915,
+	LRMAC_REGION_COUNT,
+} lrmac_region_id_t;
+
+/**
+ * Default RX setting of one plan channel.
+ */
+typedef struct{
+	long    freq; /** Hz */
+	uint8_t sf;
+	long    bw;   /** Hz */
+	uint8_t cdr;  /** 4/cdr */
+} lrmac_region_channel_t;
+
+/**
+ * Transmit duty cycle limit of one sub-band, 0 permille is unlimited.
+ */
+typedef struct{
+	long     freq_min;      /** Hz */
+	long     freq_max;      /** Hz */
+	uint16_t duty_permille;
+} lrmac_region_subband_t;
+
+/**
+ * Band limits apply to downlinks, channel tables to the radios receiving.
+ */
+typedef struct{
+	lrmac_region_id_t            id;
+	const char                   *name;
+	long                         freq_min;  /** Hz */
+	long                         freq_max;  /** Hz */
+	int8_t                       power_min; /** dBm */
+	int8_t                       power_max; /** dBm */
+	long                         raster_base; /** Hz, channel frequencies sit on base + n * step */
+	long                         raster_step; /** Hz */
+	uint8_t                      channel_count;
+	const lrmac_region_channel_t *channel;
+	uint8_t                      subband_count;
+	const lrmac_region_subband_t *subband;
+	int16_t                      lbt_rssi;  /** dBm, listen before talk threshold, 0 without LBT */
+	uint16_t                     lbt_us;    /** Listen time before each TX */
+} lrmac_region_t;
+
+const lrmac_region_t *lrmac_region_get(lrmac_region_id_t id);
+const lrmac_region_t *lrmac_region_find(const char *name);
+
+long lrmac_region_freq_hz(double mhz);
+int16_t lrmac_region_raster_index(const lrmac_region_t *region, long freq);
+int8_t lrmac_region_subband_index(const lrmac_region_t *region, long freq);
+
+bool lrmac_region_check_freq(const lrmac_region_t *region, long freq);
+bool lrmac_region_check_power(const lrmac_region_t *region, int8_t power);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LORAWAN_LRMAC_LRMAC_REGION_H_ */
@@ -0,0 +1,75 @@
+/*
+ * lrmac_ring.cpp
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: anh
+ */
+
+#include "lorawan/lrmac/lrmac_ring.h"
+
+#include "string.h"
+
+
+static_assert(LRMAC_RING_PAYLOAD_SIZE > LRPHYS_MAX_PKT_LENGTH, "Ring payload must hold a full frame and NUL");
+
+bool lrmac_ring_attach(lrmac_ring_t *ring, lrmac_ring_entry_t *entry, uint16_t depth){
+	if(entry == NULL || depth == 0 || (depth & (depth - 1)) != 0) return false;
+
+	ring->entry = entry;
+	ring->depth = depth;
+	lrmac_ring_clear(ring);
+
+	return true;
+}
+
+/**
+ * Drops whatever is waiting, call with producer and consumer stopped.
+ */
+void lrmac_ring_clear(lrmac_ring_t *ring){
+	__atomic_store_n(&ring->head, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&ring->tail, 0, __ATOMIC_RELAXED);
+	memset((void *)&ring->stats, 0, sizeof(lrmac_ring_stats_t));
+	ring->stats.depth = ring->depth;
+}
+
+lrmac_packet_t *lrmac_ring_reserve(lrmac_ring_t *ring){
+	uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+	uint32_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+
+	if(ring->entry == NULL || head - tail >= ring->depth){
+		ring->stats.dropped++;
+		return NULL;
+	}
+
+	lrmac_ring_entry_t *entry = &ring->entry[head & (ring->depth - 1)];
+	entry->packet = lrmac_packet_t();
+	entry->packet.payload = entry->data;
+
+	return &entry->packet;
+}
+
+void lrmac_ring_commit(lrmac_ring_t *ring){
+	uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_RELAXED) + 1;
+	uint16_t count = (uint16_t)(head - __atomic_load_n(&ring->tail, __ATOMIC_RELAXED));
+
+	__atomic_store_n(&ring->head, head, __ATOMIC_RELEASE);
+
+	ring->stats.pushed++;
+	if(count > ring->stats.high_water) ring->stats.high_water = count;
+}
+
+lrmac_packet_t *lrmac_ring_peek(lrmac_ring_t *ring){
+	uint32_t tail = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+
+	if(tail == __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE)) return NULL;
+
+	return &ring->entry[tail & (ring->depth - 1)].packet;
+}
+
+void lrmac_ring_release(lrmac_ring_t *ring){
+	__atomic_store_n(&ring->tail, __atomic_load_n(&ring->tail, __ATOMIC_RELAXED) + 1, __ATOMIC_RELEASE);
+}
+
+uint16_t lrmac_ring_count(lrmac_ring_t *ring){
+	return (uint16_t)(__atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE));
+}
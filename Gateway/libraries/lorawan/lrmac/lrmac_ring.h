@@ -0,0 +1,64 @@
+/*
+ * lrmac_ring.h
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: anh
+ */
+
+#ifndef LORAWAN_LRMAC_LRMAC_RING_H_
+#define LORAWAN_LRMAC_LRMAC_RING_H_
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+#include "lorawan/lrmac/lrmac.h"
+
+
+/**
+ * Payload room of an entry, a full LoRa frame and the terminating NUL the RX
+ * path appends.
+ */
+#define LRMAC_RING_PAYLOAD_SIZE 256U
+
+/**
+ * One received frame, descriptor and payload stored in place.
+ */
+typedef struct{
+	lrmac_packet_t packet;
+	uint8_t        data[LRMAC_RING_PAYLOAD_SIZE];
+} lrmac_ring_entry_t;
+
+/**
+ * Single producer (the radio event context), single consumer (the forward
+ * task) ring. head and tail run freely and are each written by one side
+ * only, so neither side takes a lock or a critical section.
+ * depth must be a power of two.
+ */
+typedef struct{
+	lrmac_ring_entry_t *entry;
+	uint16_t           depth;
+	uint32_t           head;
+	uint32_t           tail;
+	lrmac_ring_stats_t stats;
+} lrmac_ring_t;
+
+bool lrmac_ring_attach(lrmac_ring_t *ring, lrmac_ring_entry_t *entry, uint16_t depth);
+void lrmac_ring_clear(lrmac_ring_t *ring);
+
+/** Producer side: fill the reserved packet in place, then commit it. */
+lrmac_packet_t *lrmac_ring_reserve(lrmac_ring_t *ring);
+void lrmac_ring_commit(lrmac_ring_t *ring);
+
+/** Consumer side: oldest committed packet, released once handled. */
+lrmac_packet_t *lrmac_ring_peek(lrmac_ring_t *ring);
+void lrmac_ring_release(lrmac_ring_t *ring);
+
+uint16_t lrmac_ring_count(lrmac_ring_t *ring);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LORAWAN_LRMAC_LRMAC_RING_H_ */
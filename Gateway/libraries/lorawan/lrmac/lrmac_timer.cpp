@@ -0,0 +1,262 @@
+/*
+ * lrmac_timer.cpp
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: anh
+ */
+
+#include "lorawan/gateway/gateway_config.h"
+#include "lorawan/lrmac/lrmac_timer.h"
+#include "lorawan/lrmac/lrmac_region.h"
+
+#include "string.h"
+
+
+/**
+ * a strictly before b on the wrapping 32-bit counter.
+ */
+#define LRMAC_TIMER_BEFORE(a, b) ((int32_t)((a) - (b)) < 0)
+
+/**
+ * The downlink scheduler wakes lead plus listen time ahead of tmst and ends
+ * in lrmac_timer_wait(), which only spins LRMAC_TIMER_SPIN_MAX_US. Any more
+ * and the TX would start early.
+ */
+static_assert(LRWGW_SCHED_LEAD_US + LRMAC_REGION_LBT_US_MAX < LRMAC_TIMER_SPIN_MAX_US,
+		"Scheduler lead and LBT exceed the lrmac_timer_wait() spin");
+
+typedef struct{
+	uint32_t key;
+	void     *item;
+} lrmac_timer_node_t;
+
+static lrmac_timer_node_t timer_heap[LRWGW_SCHED_SIZE];
+static uint16_t timer_count = 0;
+static TIM_HandleTypeDef *timer_tim = NULL;
+static uint32_t timer_channel = 0;
+static uint32_t timer_it = 0;
+static TaskHandle_t *timer_ptask = NULL;
+static lrmac_timer_stats_t timer_stats;
+
+static void lrmac_timer_sift_up(uint16_t index);
+static void lrmac_timer_sift_down(uint16_t index);
+static void *lrmac_timer_remove_head(void);
+static bool lrmac_timer_arm(void);
+static void lrmac_timer_notify(void);
+
+
+
+/**
+ * Output compare channel in timing mode, no pin is driven. The compare
+ * interrupt is only enabled while something is pending.
+ */
+bool lrmac_timer_initialize(TIM_HandleTypeDef *tim, uint32_t channel, TaskHandle_t *ptask){
+	TIM_OC_InitTypeDef oc = {0};
+
+	switch(channel){
+		case TIM_CHANNEL_1: timer_it = TIM_IT_CC1; break;
+		case TIM_CHANNEL_2: timer_it = TIM_IT_CC2; break;
+		case TIM_CHANNEL_3: timer_it = TIM_IT_CC3; break;
+		case TIM_CHANNEL_4: timer_it = TIM_IT_CC4; break;
+		default: return false;
+	}
+
+	oc.OCMode     = TIM_OCMODE_TIMING;
+	oc.Pulse      = 0;
+	oc.OCPolarity = TIM_OCPOLARITY_HIGH;
+	oc.OCFastMode = TIM_OCFAST_DISABLE;
+
+	taskENTER_CRITICAL();
+	__HAL_TIM_DISABLE_IT(tim, timer_it);
+	timer_tim     = tim;
+	timer_channel = channel;
+	timer_ptask   = ptask;
+	timer_count   = 0;
+	memset((void *)&timer_stats, 0, sizeof(lrmac_timer_stats_t));
+	taskEXIT_CRITICAL();
+
+	return HAL_TIM_OC_ConfigChannel(tim, &oc, channel) == HAL_OK;
+}
+
+uint32_t lrmac_timer_now(void){
+	return (timer_tim != NULL)? __HAL_TIM_GET_COUNTER(timer_tim) : 0;
+}
+
+/**
+ * Add item due at key, false when the heap is full. Equal keys leave in no
+ * particular order.
+ */
+bool lrmac_timer_schedule(uint32_t key, void *item){
+	bool due;
+
+	taskENTER_CRITICAL();
+	if(timer_count >= LRWGW_SCHED_SIZE){
+		timer_stats.full++;
+		taskEXIT_CRITICAL();
+		return false;
+	}
+	timer_heap[timer_count].key  = key;
+	timer_heap[timer_count].item = item;
+	lrmac_timer_sift_up(timer_count++);
+
+	timer_stats.scheduled++;
+	if(timer_count > timer_stats.pending_max) timer_stats.pending_max = timer_count;
+	due = lrmac_timer_arm();
+	taskEXIT_CRITICAL();
+
+	if(due) lrmac_timer_notify();
+
+	return true;
+}
+
+/**
+ * Earliest item if its key has come, else NULL. Call until NULL after every
+ * notification, the compare is rearmed on the next key each time.
+ */
+void *lrmac_timer_expired(void){
+	void *item = NULL;
+	bool due;
+
+	taskENTER_CRITICAL();
+	if(timer_count > 0 && !LRMAC_TIMER_BEFORE(lrmac_timer_now(), timer_heap[0].key))
+		item = lrmac_timer_remove_head();
+	due = lrmac_timer_arm();
+	taskEXIT_CRITICAL();
+
+	if(item == NULL && due) lrmac_timer_notify();
+
+	return item;
+}
+
+/**
+ * Earliest item whether due or not, NULL when empty, e.g. to drain the heap.
+ */
+void *lrmac_timer_pop(void){
+	void *item = NULL;
+
+	taskENTER_CRITICAL();
+	if(timer_count > 0) item = lrmac_timer_remove_head();
+	lrmac_timer_arm();
+	taskEXIT_CRITICAL();
+
+	return item;
+}
+
+uint16_t lrmac_timer_pending(void){
+	return timer_count;
+}
+
+/**
+ * Busy wait for target, up to LRMAC_TIMER_SPIN_MAX_US, and account the
+ * dispatch error. Returns the error, positive when late, negative when
+ * called further ahead than the spin covers.
+ */
+int32_t lrmac_timer_wait(uint32_t target){
+	int32_t left = (int32_t)(target - lrmac_timer_now());
+
+	if(left <= 0)
+		timer_stats.late++;
+	else if((uint32_t)left <= LRMAC_TIMER_SPIN_MAX_US)
+		while(LRMAC_TIMER_BEFORE(lrmac_timer_now(), target));
+
+	int32_t jitter = (int32_t)(lrmac_timer_now() - target);
+	uint32_t error = (jitter < 0)? (uint32_t)-jitter : (uint32_t)jitter;
+
+	timer_stats.dispatched++;
+	timer_stats.jitter_us = jitter;
+	if(error > timer_stats.jitter_us_max) timer_stats.jitter_us_max = error;
+
+	return jitter;
+}
+
+/**
+ * Compare match entry, from HAL_TIM_OC_DelayElapsedCallback().
+ */
+void lrmac_timer_handler(TIM_HandleTypeDef *htim){
+	BaseType_t woken = pdFALSE;
+
+	if(htim != timer_tim || (uint32_t)htim->Channel != (1U << (timer_channel / 4))) return;
+
+	__HAL_TIM_DISABLE_IT(timer_tim, timer_it);
+	timer_stats.fired++;
+	if(timer_ptask != NULL && *timer_ptask != NULL)
+		vTaskNotifyGiveFromISR(*timer_ptask, &woken);
+
+	portYIELD_FROM_ISR(woken);
+}
+
+void lrmac_timer_get_stats(lrmac_timer_stats_t *stats){
+	*stats = timer_stats;
+}
+
+void lrmac_timer_reset_stats(void){
+	memset((void *)&timer_stats, 0, sizeof(lrmac_timer_stats_t));
+	timer_stats.pending_max = timer_count;
+}
+
+
+static void lrmac_timer_sift_up(uint16_t index){
+	lrmac_timer_node_t node = timer_heap[index];
+
+	while(index > 0){
+		uint16_t parent = (index - 1) / 2;
+		if(!LRMAC_TIMER_BEFORE(node.key, timer_heap[parent].key)) break;
+
+		timer_heap[index] = timer_heap[parent];
+		index = parent;
+	}
+	timer_heap[index] = node;
+}
+
+static void lrmac_timer_sift_down(uint16_t index){
+	lrmac_timer_node_t node = timer_heap[index];
+
+	while(true){
+		uint16_t child = 2 * index + 1;
+		if(child >= timer_count) break;
+		if(child + 1 < timer_count && LRMAC_TIMER_BEFORE(timer_heap[child + 1].key, timer_heap[child].key)) child++;
+		if(!LRMAC_TIMER_BEFORE(timer_heap[child].key, node.key)) break;
+
+		timer_heap[index] = timer_heap[child];
+		index = child;
+	}
+	timer_heap[index] = node;
+}
+
+static void *lrmac_timer_remove_head(void){
+	void *item = timer_heap[0].item;
+
+	if(--timer_count > 0){
+		timer_heap[0] = timer_heap[timer_count];
+		lrmac_timer_sift_down(0);
+	}
+
+	return item;
+}
+
+/**
+ * Compare on the earliest key, inside a critical section. A key the counter
+ * has already passed never matches, true tells the caller to notify instead.
+ */
+static bool lrmac_timer_arm(void){
+	if(timer_tim == NULL) return false;
+	if(timer_count == 0){
+		__HAL_TIM_DISABLE_IT(timer_tim, timer_it);
+		return false;
+	}
+
+	__HAL_TIM_SET_COMPARE(timer_tim, timer_channel, timer_heap[0].key);
+	__HAL_TIM_CLEAR_IT(timer_tim, timer_it);
+	__HAL_TIM_ENABLE_IT(timer_tim, timer_it);
+
+	return !LRMAC_TIMER_BEFORE(lrmac_timer_now(), timer_heap[0].key);
+}
+
+static void lrmac_timer_notify(void){
+	if(timer_ptask != NULL && *timer_ptask != NULL)
+		xTaskNotifyGive(*timer_ptask);
+}
+
+extern "C" void HAL_TIM_OC_DelayElapsedCallback(TIM_HandleTypeDef *htim){
+	lrmac_timer_handler(htim);
+}
@@ -0,0 +1,63 @@
+/*
+ * lrmac_timer.h
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: anh
+ */
+
+#ifndef LORAWAN_LRMAC_LRMAC_TIMER_H_
+#define LORAWAN_LRMAC_LRMAC_TIMER_H_
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+#include "stm32h7xx_hal.h"
+#include "FreeRTOS.h"
+#include "task.h"
+
+
+/**
+ * Group: Downlink timer.
+ * Min-heap of items keyed by absolute counter value of a 32-bit free running
+ * 1 MHz timer (the tmst timebase), the earliest armed on an output compare
+ * channel of the same timer. Keys compare wrap safe, so every pending key has
+ * to be within 2^31 us (about 35 minutes) of the counter.
+ */
+#define LRMAC_TIMER_SPIN_MAX_US 20000U /** Longest lrmac_timer_wait() busy wait */
+
+typedef struct{
+	uint32_t scheduled;
+	uint32_t full;          /** Refused, heap full */
+	uint32_t fired;         /** Compare interrupts taken */
+	uint32_t dispatched;    /** Waits ended, TX started */
+	uint32_t late;          /** Target already gone at the wait */
+	int32_t  jitter_us;     /** Last dispatch, start minus target */
+	uint32_t jitter_us_max; /** Largest dispatch error either way */
+	uint32_t pending_max;
+} lrmac_timer_stats_t;
+
+/**
+ * ptask is notified, from the compare interrupt, whenever the earliest key is
+ * due. The timer has to be counting already.
+ */
+bool lrmac_timer_initialize(TIM_HandleTypeDef *tim, uint32_t channel, TaskHandle_t *ptask);
+uint32_t lrmac_timer_now(void);
+
+bool lrmac_timer_schedule(uint32_t key, void *item);
+void *lrmac_timer_expired(void);
+void *lrmac_timer_pop(void);
+uint16_t lrmac_timer_pending(void);
+
+int32_t lrmac_timer_wait(uint32_t target);
+void lrmac_timer_handler(TIM_HandleTypeDef *htim);
+
+void lrmac_timer_get_stats(lrmac_timer_stats_t *stats);
+void lrmac_timer_reset_stats(void);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LORAWAN_LRMAC_LRMAC_TIMER_H_ */
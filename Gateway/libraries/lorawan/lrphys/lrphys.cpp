@@ -7,21 +7,104 @@
 
 #include "lorawan/lrphys/lrphys.h"
 
+#include "string.h"
+
+#include "task.h"
+
+
+static lrphys *lrphys_instances[LRPHYS_MAX_INSTANCES] = {NULL};
+
+static bool lrphys_is_shadowed(uint8_t address);
+static uint8_t lrphys_bandwidth_index(long sbw);
+static inline uint8_t lrphys_snap(const uint8_t *regs, uint8_t address);
+static int32_t lrphys_freq_error_hz(const uint8_t *ferr, long bw);
+
+static const uint8_t lrphys_profile_regs[LRPHYS_PROFILE_REGS] = {
+	LRPHYS_REG_FRF_MSB,
+	LRPHYS_REG_FRF_MID,
+	LRPHYS_REG_FRF_LSB,
+	LRPHYS_REG_PA_CONFIG,
+	LRPHYS_REG_OCP,
+	LRPHYS_REG_MODEM_CONFIG_1,
+	LRPHYS_REG_MODEM_CONFIG_2,
+	LRPHYS_REG_PREAMBLE_MSB,
+	LRPHYS_REG_PREAMBLE_LSB,
+	LRPHYS_REG_MODEM_CONFIG_3,
+	LRPHYS_REG_DETECTION_OPTIMIZE,
+	LRPHYS_REG_INVERTIQ,
+	LRPHYS_REG_DETECTION_THRESHOLD,
+	LRPHYS_REG_SYNC_WORD,
+	LRPHYS_REG_INVERTIQ2,
+	LRPHYS_REG_PA_DAC,
+};
+
+static void lrphys_dma_release(lrphys *phys, bool success, void *arg);
+static void lrphys_task_service_irq(void *param);
+static void lrphys_dma_dispatch(SPI_HandleTypeDef *hspi, bool success);
+
+
+
 lrphys::lrphys(void) {
 }
 
 bool lrphys::initialize(lrphys_hwconfig_t *conf) {
 	_conf = conf;
 
-	HAL_GPIO_WritePin(_conf->cs_port, _conf->cs_pin, GPIO_PIN_SET);
-	HAL_GPIO_WritePin(_conf->rst_port, _conf->rst_pin, GPIO_PIN_RESET);
-	HAL_Delay(50);
-	HAL_GPIO_WritePin(_conf->rst_port, _conf->rst_pin, GPIO_PIN_SET);
-	HAL_Delay(50);
+	if (_dma_done == NULL)
+		_dma_done = xSemaphoreCreateBinary();
+	if (_lock == NULL)
+		_lock = xSemaphoreCreateRecursiveMutex();
+
+	/**
+	 * Cycle counter for interrupt service timing.
+	 */
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+	if (_service_task == NULL)
+		xTaskCreate(lrphys_task_service_irq, "lrphys_service",
+				LRPHYS_SERVICE_TASK_STACK_SIZE / 4, (void*) this,
+				LRPHYS_SERVICE_TASK_PRIORITY, &_service_task);
+
+	for (int i = 0; i < LRPHYS_MAX_INSTANCES; i++) {
+		if (lrphys_instances[i] == this)
+			break;
+		if (lrphys_instances[i] == NULL) {
+			lrphys_instances[i] = this;
+			break;
+		}
+	}
+
+	if (_conf->tim != NULL && _conf->tim_capture) {
+		TIM_IC_InitTypeDef ic = {0};
+
+		ic.ICPolarity = TIM_ICPOLARITY_RISING;
+		ic.ICSelection = TIM_ICSELECTION_DIRECTTI;
+		ic.ICPrescaler = TIM_ICPSC_DIV1;
+		ic.ICFilter = 0;
+		HAL_TIM_IC_ConfigChannel(_conf->tim, &ic, _conf->tim_channel);
+		HAL_TIM_IC_Start_IT(_conf->tim, _conf->tim_channel);
+	}
+
+	if (_conf->transfer == NULL)
+		_regio.transport.attach(_conf->spi->Instance, _conf->cs_port, _conf->cs_pin);
+
+	if (_conf->cs_port != NULL)
+		HAL_GPIO_WritePin(_conf->cs_port, _conf->cs_pin, GPIO_PIN_SET);
+	if (_conf->rst_port != NULL) {
+		HAL_GPIO_WritePin(_conf->rst_port, _conf->rst_pin, GPIO_PIN_RESET);
+		HAL_Delay(50);
+		HAL_GPIO_WritePin(_conf->rst_port, _conf->rst_pin, GPIO_PIN_SET);
+		HAL_Delay(50);
+	}
+	lock();
+	shadow_invalidate();
 
 	uint8_t version = readRegister(LRPHYS_REG_VERSION);
-	if (version != 0x12)
+	if (version != 0x12) {
+		unlock();
 		return false;
+	}
 
 	_freq = 433E6;
 	sleep();
@@ -36,15 +119,37 @@ bool lrphys::initialize(lrphys_hwconfig_t *conf) {
 	set_spreadingfactor(7);
 	set_bandwidth(125E3);
 	set_codingrate4(4);
+	unlock();
 
 	return true;
 }
 
 void lrphys::stop(void){
+	lock();
 	idle();
 	sleep();
 
-	HAL_GPIO_WritePin(_conf->cs_port, _conf->cs_pin, GPIO_PIN_SET);
+	if (_conf->cs_port != NULL)
+		HAL_GPIO_WritePin(_conf->cs_port, _conf->cs_pin, GPIO_PIN_SET);
+	unlock();
+}
+
+/**
+ * Exclusive use of the chip. The service task, the downlink scheduler and the
+ * reactor all reach the radio, every register access and every sequence that
+ * has to stay together (profile, FIFO load, TX start) runs under it. Recursive,
+ * compound operations nest over the register primitives.
+ */
+void lrphys::lock(void) {
+	if (_lock != NULL && !xPortIsInsideInterrupt()
+			&& xTaskGetSchedulerState() == taskSCHEDULER_RUNNING)
+		xSemaphoreTakeRecursive(_lock, portMAX_DELAY);
+}
+
+void lrphys::unlock(void) {
+	if (_lock != NULL && !xPortIsInsideInterrupt()
+			&& xTaskGetSchedulerState() == taskSCHEDULER_RUNNING)
+		xSemaphoreGiveRecursive(_lock);
 }
 
 void lrphys::register_event_handler(lrphys_evtcb_f event_handler_function,
@@ -60,8 +165,13 @@ int16_t lrphys::rssi(void) {
 }
 
 void lrphys::set_mode_receive_it(uint8_t size) {
+	lock();
+	_cad_scan = false;
+	_cad_locked = false;
+	_rx_next_valid = false;
+
 	if (_event_handler != NULL)
-		writeRegister(LRPHYS_REG_DIO_MAPPING_1, 0x00); // DIO0 => RXDONE
+		writeRegister(LRPHYS_REG_DIO_MAPPING_1, LRPHYS_DIO0_RX_DONE);
 
 	if (size > 0) {
 		implicitHeaderMode();
@@ -73,11 +183,69 @@ void lrphys::set_mode_receive_it(uint8_t size) {
 
 	writeRegister(LRPHYS_REG_OP_MODE,
 			LRPHYS_MODE_LONG_RANGE_MODE | LRPHYS_MODE_RX_CONTINUOUS);
+	unlock();
+}
+
+/**
+ * Multi spreading factor reception.
+ * Channel activity detection steps through sf_min..sf_max, a detection locks
+ * the receiver on that spreading factor until RxDone, CRC error or timeout,
+ * then the scan starts over. Explicit header only.
+ */
+void lrphys::set_mode_cad_scan(uint8_t sf_min, uint8_t sf_max) {
+	if (sf_min < LRPHYS_CAD_SF_MIN)
+		sf_min = LRPHYS_CAD_SF_MIN;
+	if (sf_max > LRPHYS_CAD_SF_MAX)
+		sf_max = LRPHYS_CAD_SF_MAX;
+	if (sf_min > sf_max)
+		sf_min = sf_max;
+
+	lock();
+	_cad_sf_min = sf_min;
+	_cad_sf_max = sf_max;
+
+	explicitHeaderMode();
+
+	_cad_scan = true;
+	cad_start(_cad_sf_min);
+	unlock();
+}
+
+bool lrphys::is_cad_scanning(void) {
+	return _cad_scan;
+}
+
+/**
+ * A frame is being demodulated or CAD holds a detection, retuning now loses it.
+ */
+bool lrphys::is_receiving(void) {
+	if (_cad_locked)
+		return true;
+
+	return (readRegister(LRPHYS_REG_MODEM_STAT) & LRPHYS_MODEM_STAT_RX_ONGOING) != 0;
+}
+
+/**
+ * CAD holds a detection, the RX in progress state kept in RAM, no SPI.
+ */
+bool lrphys::is_rx_locked(void) {
+	return _cad_locked;
+}
+
+void lrphys::get_cad_stats(lrphys_cad_stats_t *stats) {
+	*stats = _cad_stats;
+}
+
+void lrphys::reset_cad_stats(void) {
+	memset((void*) &_cad_stats, 0, sizeof(lrphys_cad_stats_t));
 }
 
 bool lrphys::packet_begin(bool implicitHeader) {
-	if (is_transmitting())
+	lock();
+	if (is_transmitting()) {
+		unlock();
 		return false;
+	}
 
 	idle();
 
@@ -88,13 +256,15 @@ bool lrphys::packet_begin(bool implicitHeader) {
 
 	writeRegister(LRPHYS_REG_FIFO_ADDR_PTR, 0);
 	writeRegister(LRPHYS_REG_PAYLOAD_LENGTH, 0);
+	unlock();
 
 	return true;
 }
 
 bool lrphys::packet_end(bool async) {
+	lock();
 	if (async && (_event_handler != NULL))
-		writeRegister(LRPHYS_REG_DIO_MAPPING_1, 0x40);
+		writeRegister(LRPHYS_REG_DIO_MAPPING_1, LRPHYS_DIO0_TX_DONE);
 
 	writeRegister(LRPHYS_REG_OP_MODE,
 			LRPHYS_MODE_LONG_RANGE_MODE | LRPHYS_MODE_TX);
@@ -105,6 +275,7 @@ bool lrphys::packet_end(bool async) {
 			;
 		writeRegister(LRPHYS_REG_IRQ_FLAGS, LRPHYS_IRQ_TX_DONE_MASK);
 	}
+	unlock();
 
 	return true;
 }
@@ -121,6 +292,8 @@ bool lrphys::is_transmitting(void) {
 
 uint8_t lrphys::packet_parse(uint8_t size) {
 	uint8_t packetLength = 0;
+
+	lock();
 	uint8_t irqFlags = readRegister(LRPHYS_REG_IRQ_FLAGS);
 
 	if (size > 0) {
@@ -133,27 +306,23 @@ uint8_t lrphys::packet_parse(uint8_t size) {
 
 	if ((irqFlags & LRPHYS_IRQ_RX_DONE_MASK)
 			&& (irqFlags & LRPHYS_IRQ_PAYLOAD_CRC_ERROR_MASK) == 0) {
-		_packetIndex = 0;
-
-		if (_implicitHeaderMode)
-			packetLength = readRegister(LRPHYS_REG_PAYLOAD_LENGTH);
-		else
-			packetLength = readRegister(LRPHYS_REG_RX_NB_BYTES);
-
-		writeRegister(LRPHYS_REG_FIFO_ADDR_PTR,
-				readRegister(LRPHYS_REG_FIFO_RX_CURRENT_ADDR));
-
-		idle();
+		packetLength = rx_capture(1);
 	} else if (irqFlags & LRPHYS_IRQ_PAYLOAD_CRC_ERROR_MASK) {
+		_rx_stats.crc_errors++;
+		rx_capture(1);
+
 		if (_event_handler)
 			_event_handler(_event_parameter, LRPHYS_ERROR_CRC, 0);
 	} else if (readRegister(LRPHYS_REG_OP_MODE)
-			!= (LRPHYS_MODE_LONG_RANGE_MODE | LRPHYS_MODE_RX_SINGLE)) {
-		writeRegister(LRPHYS_REG_FIFO_ADDR_PTR, 0);
-
+			!= (LRPHYS_MODE_LONG_RANGE_MODE | LRPHYS_MODE_RX_CONTINUOUS)) {
+		/**
+		 * Keep listening, the modem moves on to the next frame by itself.
+		 */
+		_rx_next_valid = false;
 		writeRegister(LRPHYS_REG_OP_MODE,
-				LRPHYS_MODE_LONG_RANGE_MODE | LRPHYS_MODE_RX_SINGLE);
+				LRPHYS_MODE_LONG_RANGE_MODE | LRPHYS_MODE_RX_CONTINUOUS);
 	}
+	unlock();
 
 	return packetLength;
 }
@@ -164,27 +333,22 @@ int lrphys::packet_rssi(void) {
 					LRPHYS_RSSI_OFFSET_LF_PORT : LRPHYS_RSSI_OFFSET_HF_PORT));
 }
 
-float lrphys::packet_snr(void) {
-	return ((float) readRegister(LRPHYS_REG_PKT_SNR_VALUE)) * 0.25;
+/**
+ * Packet SNR in 0.25 dB steps (Q5.2 dB), the register value as is.
+ */
+int8_t lrphys::packet_snr(void) {
+	return (int8_t) readRegister(LRPHYS_REG_PKT_SNR_VALUE);
 }
 
 long lrphys::packet_freq_error(void) {
-	int32_t freqError = 0;
-	freqError = static_cast<int32_t>(readRegister(LRPHYS_REG_FREQ_ERROR_MSB)
-			& 0b111);
-	freqError <<= 8L;
-	freqError += static_cast<int32_t>(readRegister(LRPHYS_REG_FREQ_ERROR_MID));
-	freqError <<= 8L;
-	freqError += static_cast<int32_t>(readRegister(LRPHYS_REG_FREQ_ERROR_LSB));
-
-	if (readRegister(LRPHYS_REG_FREQ_ERROR_MSB) & 0b1000)
-		freqError -= 524288;
+	uint8_t ferr[3];
 
-	const float fXtal = 32E6;
-	const float fError = ((static_cast<float>(freqError) * (1L << 24)) / fXtal)
-			* (get_bandwidth() / 500000.0f); // p. 37
+	lock();
+	burstRead(LRPHYS_REG_FREQ_ERROR_MSB, ferr, sizeof(ferr));
+	long bw = get_bandwidth();
+	unlock();
 
-	return static_cast<long>(fError);
+	return lrphys_freq_error_hz(ferr, bw);
 }
 
 size_t lrphys::transmit(uint8_t byte) {
@@ -192,15 +356,16 @@ size_t lrphys::transmit(uint8_t byte) {
 }
 
 size_t lrphys::transmit(const uint8_t *buffer, size_t size) {
+	lock();
 	int currentLength = readRegister(LRPHYS_REG_PAYLOAD_LENGTH);
 
 	if ((currentLength + size) > LRPHYS_MAX_PKT_LENGTH)
 		size = LRPHYS_MAX_PKT_LENGTH - currentLength;
 
-	for (size_t i = 0; i < size; i++)
-		writeRegister(LRPHYS_REG_FIFO, buffer[i]);
+	burstWrite(LRPHYS_REG_FIFO, buffer, size);
 
 	writeRegister(LRPHYS_REG_PAYLOAD_LENGTH, currentLength + size);
+	unlock();
 
 	return size;
 }
@@ -209,40 +374,76 @@ uint8_t lrphys::available(void) {
 	return (readRegister(LRPHYS_REG_RX_NB_BYTES) - _packetIndex);
 }
 
-uint8_t lrphys::receive(char *buffer) {
-	uint8_t i = 0;
-	while (available()) {
-		_packetIndex++;
-
-		buffer[i++] = readRegister(LRPHYS_REG_FIFO);
+uint8_t lrphys::receive(char *buffer, uint8_t size) {
+	lock();
+	uint8_t len = available();
+
+	if (len > size)
+		len = size;
+
+	/**
+	 * Drain the whole payload in one CS-asserted transfer, FIFO address
+	 * pointer auto increments on the chip side.
+	 */
+	burstRead(LRPHYS_REG_FIFO, (uint8_t*) buffer, len);
+	_packetIndex += len;
+
+	/**
+	 * The modem keeps receiving while the frame is drained, check it did not
+	 * wrap around the FIFO into it.
+	 */
+	if (_rx_next_valid) {
+		uint8_t ahead = (uint8_t) (readRegister(LRPHYS_REG_FIFO_RX_BYTE_ADDR) + 1
+				- _rx_next_addr);
+
+		if ((uint16_t) ahead + _rx_length > 256)
+			_rx_stats.overwritten++;
 	}
+	unlock();
+
 	return _packetIndex;
 }
 
 uint8_t lrphys::peek(void) {
-	if (!available())
+	lock();
+	if (!available()) {
+		unlock();
 		return -1;
+	}
 
 	int currentAddress = readRegister(LRPHYS_REG_FIFO_ADDR_PTR);
 
 	uint8_t b = readRegister(LRPHYS_REG_FIFO);
 
 	writeRegister(LRPHYS_REG_FIFO_ADDR_PTR, currentAddress);
+	unlock();
 
 	return b;
 }
 
 void lrphys::idle(void) {
+	lock();
+	_cad_scan = false;
+	_cad_locked = false;
+
 	writeRegister(LRPHYS_REG_OP_MODE,
 			LRPHYS_MODE_LONG_RANGE_MODE | LRPHYS_MODE_STDBY);
+	unlock();
 }
 
 void lrphys::sleep(void) {
+	lock();
+	_cad_scan = false;
+	_cad_locked = false;
+
 	writeRegister(LRPHYS_REG_OP_MODE,
 			LRPHYS_MODE_LONG_RANGE_MODE | LRPHYS_MODE_SLEEP);
+	shadow_invalidate();
+	unlock();
 }
 
 void lrphys::set_txpower(uint8_t level, uint8_t outputPin) {
+	lock();
 	if (LRPHYS_PA_OUTPUT_RFO_PIN == outputPin) {
 		if (level < 0)
 			level = 0;
@@ -267,17 +468,20 @@ void lrphys::set_txpower(uint8_t level, uint8_t outputPin) {
 
 		writeRegister(LRPHYS_REG_PA_CONFIG, LRPHYS_PA_BOOST | (level - 2));
 	}
+	unlock();
 }
 
 void lrphys::set_frequency(long frequency) {
 	uint64_t frf;
 
+	lock();
 	_freq = frequency;
 	frf = ((uint64_t) _freq << 19) / 32000000;
 
 	writeRegister(LRPHYS_REG_FRF_MSB, (uint8_t) (frf >> 16));
 	writeRegister(LRPHYS_REG_FRF_MID, (uint8_t) (frf >> 8));
 	writeRegister(LRPHYS_REG_FRF_LSB, (uint8_t) (frf >> 0));
+	unlock();
 }
 
 uint8_t lrphys::get_spreadingfactor(void) {
@@ -290,6 +494,7 @@ void lrphys::set_spreadingfactor(uint8_t sf) {
 	else if (sf > 12)
 		sf = 12;
 
+	lock();
 	if (sf == 6) {
 		writeRegister(LRPHYS_REG_DETECTION_OPTIMIZE, 0xc5);
 		writeRegister(LRPHYS_REG_DETECTION_THRESHOLD, 0x0c);
@@ -302,6 +507,7 @@ void lrphys::set_spreadingfactor(uint8_t sf) {
 			(readRegister(LRPHYS_REG_MODEM_CONFIG_2) & 0x0f)
 					| ((sf << 4) & 0xf0));
 	set_LDO_flag();
+	unlock();
 }
 
 long lrphys::get_bandwidth(void) {
@@ -334,32 +540,13 @@ long lrphys::get_bandwidth(void) {
 }
 
 void lrphys::set_bandwidth(long sbw) {
-	int bw;
-
-	if (sbw <= 7.8E3)
-		bw = 0;
-	else if (sbw <= 10.4E3)
-		bw = 1;
-	else if (sbw <= 15.6E3)
-		bw = 2;
-	else if (sbw <= 20.8E3)
-		bw = 3;
-	else if (sbw <= 31.25E3)
-		bw = 4;
-	else if (sbw <= 41.7E3)
-		bw = 5;
-	else if (sbw <= 62.5E3)
-		bw = 6;
-	else if (sbw <= 125E3)
-		bw = 7;
-	else if (sbw <= 250E3)
-		bw = 8;
-	else
-		/*if (sbw <= 250E3)*/bw = 9;
+	int bw = lrphys_bandwidth_index(sbw);
 
+	lock();
 	writeRegister(LRPHYS_REG_MODEM_CONFIG_1,
 			(readRegister(LRPHYS_REG_MODEM_CONFIG_1) & 0x0f) | (bw << 4));
 	set_LDO_flag();
+	unlock();
 }
 
 void lrphys::set_LDO_flag(void) {
@@ -383,37 +570,156 @@ void lrphys::set_codingrate4(uint8_t denominator) {
 
 	uint8_t cr = denominator - 4;
 
+	lock();
 	writeRegister(LRPHYS_REG_MODEM_CONFIG_1,
 			(readRegister(LRPHYS_REG_MODEM_CONFIG_1) & 0xf1) | (cr << 1));
+	unlock();
 }
 
 void lrphys::set_preamblelength(long length) {
+	lock();
 	writeRegister(LRPHYS_REG_PREAMBLE_MSB, (uint8_t) (length >> 8));
 	writeRegister(LRPHYS_REG_PREAMBLE_LSB, (uint8_t) (length >> 0));
+	unlock();
 }
 
 void lrphys::set_syncword(uint8_t sw) {
 	writeRegister(LRPHYS_REG_SYNC_WORD, sw);
 }
 
+/**
+ * Compute the register image of a radio setting, no SPI access.
+ * Same rules as the individual set_* functions.
+ */
+void lrphys::build_profile(lrphys_profile_t *profile, long frequency,
+		uint8_t power, uint8_t sf, long sbw, uint8_t denominator,
+		long preamble, uint8_t sw, bool crc, bool invertIQ,
+		bool implicitHeader) {
+	uint64_t frf = ((uint64_t) frequency << 19) / 32000000;
+	uint8_t bw = lrphys_bandwidth_index(sbw);
+	uint8_t pa_dac, ocp_ma;
+	uint8_t ocpTrim = 27;
+
+	if (sf < 6)
+		sf = 6;
+	else if (sf > 12)
+		sf = 12;
+
+	if (denominator < 5)
+		denominator = 5;
+	else if (denominator > 8)
+		denominator = 8;
+
+	if (power > 17) {
+		if (power > 20)
+			power = 20;
+		power -= 3;
+		pa_dac = 0x87;
+		ocp_ma = 140;
+	} else {
+		if (power < 2)
+			power = 2;
+		pa_dac = 0x84;
+		ocp_ma = 100;
+	}
+	if (ocp_ma <= 120)
+		ocpTrim = (ocp_ma - 45) / 5;
+	else if (ocp_ma <= 240)
+		ocpTrim = (ocp_ma + 30) / 10;
+
+	static const long bw_table[10] = { 7800, 10400, 15600, 20800, 31250, 41700,
+			62500, 125000, 250000, 500000 };
+	long symbolDuration = 1000 / (bw_table[bw] / (1L << sf));
+
+	profile->freq = frequency;
+	profile->implicit_header = implicitHeader;
+
+	profile->value[0] = (uint8_t) (frf >> 16);
+	profile->value[1] = (uint8_t) (frf >> 8);
+	profile->value[2] = (uint8_t) (frf >> 0);
+	profile->value[3] = LRPHYS_PA_BOOST | (power - 2);
+	profile->value[4] = 0x20 | (0x1F & ocpTrim);
+	profile->value[5] = (bw << 4) | ((denominator - 4) << 1)
+			| (implicitHeader ? 0x01 : 0x00);
+	profile->value[6] = ((sf << 4) & 0xf0) | (crc ? 0x04 : 0x00);
+	profile->value[7] = (uint8_t) (preamble >> 8);
+	profile->value[8] = (uint8_t) (preamble >> 0);
+	profile->value[9] = 0x04 | ((symbolDuration > 16) ? (1 << 3) : 0);
+	profile->value[10] = (sf == 6) ? 0xc5 : 0xc3;
+	profile->value[11] = invertIQ ? 0x66 : 0x27;
+	profile->value[12] = (sf == 6) ? 0x0c : 0x0a;
+	profile->value[13] = sw;
+	profile->value[14] = invertIQ ? 0x19 : 0x1d;
+	profile->value[15] = pa_dac;
+}
+
+/**
+ * Write a precomputed profile, only registers that differ from the shadow
+ * are sent and adjacent ones go out as one burst.
+ */
+void lrphys::apply_profile(const lrphys_profile_t *profile) {
+	uint8_t i = 0;
+
+	lock();
+	while (i < LRPHYS_PROFILE_REGS) {
+		uint8_t first = LRPHYS_PROFILE_REGS, last = 0, end = i;
+		uint8_t cached;
+
+		while (end + 1 < LRPHYS_PROFILE_REGS
+				&& lrphys_profile_regs[end + 1] == lrphys_profile_regs[end] + 1)
+			end++;
+
+		for (uint8_t j = i; j <= end; j++) {
+			if (shadow_lookup(lrphys_profile_regs[j], &cached)
+					&& cached == profile->value[j])
+				continue;
+			if (first == LRPHYS_PROFILE_REGS)
+				first = j;
+			last = j;
+		}
+
+		if (first == LRPHYS_PROFILE_REGS)
+			_shadow_hits += end - i + 1;
+		else if (first == last)
+			writeRegister(lrphys_profile_regs[first], profile->value[first]);
+		else
+			burstWrite(lrphys_profile_regs[first], &profile->value[first],
+					last - first + 1);
+
+		i = end + 1;
+	}
+
+	_freq = profile->freq;
+	_implicitHeaderMode = profile->implicit_header;
+	unlock();
+}
+
 void lrphys::enable_crc(void) {
+	lock();
 	writeRegister(LRPHYS_REG_MODEM_CONFIG_2,
 			readRegister(LRPHYS_REG_MODEM_CONFIG_2) | 0x04);
+	unlock();
 }
 
 void lrphys::disable_crc(void) {
+	lock();
 	writeRegister(LRPHYS_REG_MODEM_CONFIG_2,
 			readRegister(LRPHYS_REG_MODEM_CONFIG_2) & 0xfb);
+	unlock();
 }
 
 void lrphys::enable_invertIQ(void) {
+	lock();
 	writeRegister(LRPHYS_REG_INVERTIQ, 0x66);
 	writeRegister(LRPHYS_REG_INVERTIQ2, 0x19);
+	unlock();
 }
 
 void lrphys::disable_invertIQ(void) {
+	lock();
 	writeRegister(LRPHYS_REG_INVERTIQ, 0x27);
 	writeRegister(LRPHYS_REG_INVERTIQ2, 0x1d);
+	unlock();
 }
 
 void lrphys::set_ocp(uint8_t mA) {
@@ -431,6 +737,7 @@ void lrphys::set_gain(uint8_t gain) {
 	if (gain > 6)
 		gain = 6;
 
+	lock();
 	idle();
 
 	if (gain == 0)
@@ -443,6 +750,7 @@ void lrphys::set_gain(uint8_t gain) {
 		writeRegister(LRPHYS_REG_LNA,
 				readRegister(LRPHYS_REG_LNA) | (gain << 5));
 	}
+	unlock();
 }
 
 void lrphys::explicitHeaderMode(void) {
@@ -459,58 +767,701 @@ void lrphys::implicitHeaderMode(void) {
 			readRegister(LRPHYS_REG_MODEM_CONFIG_1) | 0x01);
 }
 
+/**
+ * DIO0 interrupt entry, runs in EXTI context.
+ * Only latches the timestamp and wakes the service task, all SPI traffic
+ * is done by IRQProcess() in task context.
+ */
 void lrphys::IRQHandler(void) {
+	irq_latch((_conf->tim != NULL) ? __HAL_TIM_GET_COUNTER(_conf->tim) : 0);
+}
+
+/**
+ * DIO0 input capture entry, runs in timer interrupt context.
+ */
+void lrphys::CaptureHandler(void) {
+	irq_latch(HAL_TIM_ReadCapturedValue(_conf->tim, _conf->tim_channel));
+}
+
+bool lrphys::is_capture_source(TIM_HandleTypeDef *htim) {
+	return (_conf != NULL && _conf->tim_capture && _conf->tim == htim
+			&& (uint32_t) htim->Channel == (1U << (_conf->tim_channel / 4)));
+}
+
+void lrphys::irq_latch(uint32_t timestamp) {
+	uint32_t start = DWT->CYCCNT;
+	BaseType_t woken = pdFALSE;
+
+	_irq_cycles = start;
+	_irq_timestamp = timestamp;
+	_irq_stats.irq_count++;
+
+	if (_service_task != NULL)
+		vTaskNotifyGiveFromISR(_service_task, &woken);
+
+	_irq_stats.isr_cycles_last = DWT->CYCCNT - start;
+	if (_irq_stats.isr_cycles_last > _irq_stats.isr_cycles_max)
+		_irq_stats.isr_cycles_max = _irq_stats.isr_cycles_last;
+
+	portYIELD_FROM_ISR(woken);
+}
+
+void lrphys::IRQProcess(uint32_t pending) {
+	lock();
+	_irq_stats.latency_us_last = (DWT->CYCCNT - _irq_cycles)
+			/ (SystemCoreClock / 1000000U);
+	if (_irq_stats.latency_us_last > _irq_stats.latency_us_max)
+		_irq_stats.latency_us_max = _irq_stats.latency_us_last;
+	if (pending > 1)
+		_irq_stats.irq_coalesced += pending - 1;
+
+	_rx_timestamp = _irq_timestamp;
+
 	uint8_t irqFlags = readRegister(LRPHYS_REG_IRQ_FLAGS);
 
 	writeRegister(LRPHYS_REG_IRQ_FLAGS, irqFlags);
 
+	if (_cad_scan && (irqFlags & LRPHYS_IRQ_CAD_DONE_MASK) != 0) {
+		cad_done(irqFlags);
+		unlock();
+		return;
+	}
+
 	if ((irqFlags & LRPHYS_IRQ_PAYLOAD_CRC_ERROR_MASK) == 0) {
 		if ((irqFlags & LRPHYS_IRQ_RX_DONE_MASK) != 0) {
-			_packetIndex = 0;
-
-			uint8_t packetLength =
-					_implicitHeaderMode ?
-							readRegister(LRPHYS_REG_PAYLOAD_LENGTH) :
-							readRegister(LRPHYS_REG_RX_NB_BYTES);
-
-			writeRegister(LRPHYS_REG_FIFO_ADDR_PTR,
-					readRegister(LRPHYS_REG_FIFO_RX_CURRENT_ADDR));
+			uint8_t packetLength = rx_capture(pending);
 
 			if (_event_handler != NULL)
 				_event_handler(_event_parameter, LRPHYS_RECEIVE_COMPLETED,
 						packetLength);
 
+			if (_cad_locked)
+				cad_unlock(true);
+
 		} else if ((irqFlags & LRPHYS_IRQ_TX_DONE_MASK) != 0) {
 			if (_event_handler)
 				_event_handler(_event_parameter, LRPHYS_TRANSMIT_COMPLETED, 0);
 		}
 	} else {
+		_rx_stats.crc_errors++;
+		if ((irqFlags & LRPHYS_IRQ_RX_DONE_MASK) != 0)
+			rx_capture(pending);
+
 		if (_event_handler)
 			_event_handler(_event_parameter, LRPHYS_ERROR_CRC, 0);
+
+		if (_cad_locked)
+			cad_unlock(false);
 	}
+	unlock();
+}
+
+/**
+ * RxDone snapshot. Payload position, length and signal metrics are read in
+ * one burst so they all belong to the same frame, the FIFO pointer is then
+ * left on the payload.
+ */
+uint8_t lrphys::rx_capture(uint32_t pending) {
+	uint8_t regs[LRPHYS_RX_SNAPSHOT_SIZE];
+
+	burstRead(LRPHYS_REG_FIFO_RX_CURRENT_ADDR, regs, LRPHYS_RX_SNAPSHOT_SIZE);
+
+	uint8_t start = lrphys_snap(regs, LRPHYS_REG_FIFO_RX_CURRENT_ADDR);
+	uint8_t length = _implicitHeaderMode ?
+			lrphys_snap(regs, LRPHYS_REG_PAYLOAD_LENGTH) :
+			lrphys_snap(regs, LRPHYS_REG_RX_NB_BYTES);
+	long bw = get_bandwidth();
+
+	_rx_meta.tmst = _rx_timestamp;
+	_rx_meta.freq = _freq;
+	_rx_meta.freq_error = lrphys_freq_error_hz(
+			&regs[LRPHYS_REG_FREQ_ERROR_MSB - LRPHYS_REG_FIFO_RX_CURRENT_ADDR], bw);
+	_rx_meta.snr = (int8_t) lrphys_snap(regs, LRPHYS_REG_PKT_SNR_VALUE);
+	_rx_meta.rssi = (int16_t) lrphys_snap(regs, LRPHYS_REG_PKT_RSSI_VALUE)
+			- (_freq < LRPHYS_RF_MID_BAND_THRESHOLD ?
+					LRPHYS_RSSI_OFFSET_LF_PORT : LRPHYS_RSSI_OFFSET_HF_PORT);
+	if (_rx_meta.snr < 0)
+		_rx_meta.rssi += _rx_meta.snr / 4;
+	_rx_meta.sf = lrphys_snap(regs, LRPHYS_REG_MODEM_CONFIG_2) >> 4;
+	_rx_meta.bw = (uint16_t) (bw / 1000);
+	_rx_meta.cr = ((lrphys_snap(regs, LRPHYS_REG_MODEM_CONFIG_1) >> 1) & 0x07) + 4;
+	_rx_meta.length = length;
+
+	_packetIndex = 0;
+	rx_track(start, length, pending);
+	writeRegister(LRPHYS_REG_FIFO_ADDR_PTR, start);
+
+	return length;
+}
+
+void lrphys::get_rx_meta(lrphys_rx_meta_t *meta) {
+	*meta = _rx_meta;
+}
+
+/**
+ * RX continuous, each frame starts where the previous one ended. Anything
+ * else, or several RxDone folded into one service run, means frames were lost.
+ */
+void lrphys::rx_track(uint8_t start, uint8_t length, uint32_t pending) {
+	uint32_t lost = (pending > 1) ? pending - 1 : 0;
+
+	if (lost == 0 && _rx_next_valid && start != _rx_next_addr)
+		lost = 1;
+
+	_rx_stats.frames++;
+	_rx_stats.overruns += lost;
+
+	_rx_start = start;
+	_rx_length = length;
+	_rx_next_addr = start + length;
+	_rx_next_valid = true;
+}
+
+void lrphys::get_rx_stats(lrphys_rx_stats_t *stats) {
+	*stats = _rx_stats;
+}
+
+void lrphys::reset_rx_stats(void) {
+	memset((void*) &_rx_stats, 0, sizeof(lrphys_rx_stats_t));
+}
+
+/**
+ * Service task wait expired while locked on a CAD detection.
+ * The lock is held while the modem still reports a frame in progress.
+ */
+void lrphys::IRQTimeout(void) {
+	lock();
+	if (!_cad_locked) {
+		unlock();
+		return;
+	}
+
+	if ((readRegister(LRPHYS_REG_MODEM_STAT) & LRPHYS_MODEM_STAT_RX_ONGOING) != 0
+			&& _cad_extensions < LRPHYS_CAD_LOCK_EXTENSIONS) {
+		_cad_extensions++;
+		unlock();
+		return;
+	}
+
+	cad_unlock(false);
+	unlock();
+}
+
+TickType_t lrphys::get_service_timeout(void) {
+	if (!_cad_locked)
+		return portMAX_DELAY;
+
+	uint32_t ms = ((uint32_t) LRPHYS_CAD_LOCK_SYMBOLS << _cad_sf) / (get_bandwidth() / 1000) + 1;
+
+	return pdMS_TO_TICKS(ms);
+}
+
+void lrphys::cad_start(uint8_t sf) {
+	_cad_sf = sf;
+	_cad_locked = false;
+
+	writeRegister(LRPHYS_REG_OP_MODE,
+			LRPHYS_MODE_LONG_RANGE_MODE | LRPHYS_MODE_STDBY);
+	set_spreadingfactor(sf);
+	writeRegister(LRPHYS_REG_DIO_MAPPING_1, LRPHYS_DIO0_CAD_DONE);
+	writeRegister(LRPHYS_REG_OP_MODE,
+			LRPHYS_MODE_LONG_RANGE_MODE | LRPHYS_MODE_CAD);
+}
+
+void lrphys::cad_done(uint8_t irqFlags) {
+	uint8_t index = _cad_sf - LRPHYS_CAD_SF_MIN;
+
+	_cad_stats.cad_done[index]++;
+
+	if ((irqFlags & LRPHYS_IRQ_CAD_DETECTED_MASK) != 0) {
+		_cad_stats.cad_detected[index]++;
+		_cad_locked = true;
+		_cad_extensions = 0;
+		_rx_next_valid = false;
+
+		writeRegister(LRPHYS_REG_DIO_MAPPING_1, LRPHYS_DIO0_RX_DONE);
+		writeRegister(LRPHYS_REG_OP_MODE,
+				LRPHYS_MODE_LONG_RANGE_MODE | LRPHYS_MODE_RX_CONTINUOUS);
+		return;
+	}
+
+	cad_start((_cad_sf >= _cad_sf_max) ? _cad_sf_min : _cad_sf + 1);
+}
+
+void lrphys::cad_unlock(bool hit) {
+	uint8_t index = _cad_sf - LRPHYS_CAD_SF_MIN;
+
+	if (hit)
+		_cad_stats.hits[index]++;
+	else
+		_cad_stats.misses[index]++;
+
+	if (_cad_scan)
+		cad_start(_cad_sf_min);
+}
+
+uint32_t lrphys::get_irq_timestamp(void) {
+	return _irq_timestamp;
+}
+
+/**
+ * Timer counter latched for the event being processed, valid from the event
+ * handler.
+ */
+uint32_t lrphys::get_rx_timestamp(void) {
+	return _rx_timestamp;
+}
+
+void lrphys::get_irq_stats(lrphys_irq_stats_t *stats) {
+	*stats = _irq_stats;
+}
+
+void lrphys::reset_irq_stats(void) {
+	memset((void*) &_irq_stats, 0, sizeof(lrphys_irq_stats_t));
+}
+
+uint32_t lrphys::get_spi_transactions(void) {
+	return _spi_transactions;
+}
+
+void lrphys::reset_spi_transactions(void) {
+	_spi_transactions = 0;
+}
+
+uint32_t lrphys::get_shadow_hits(void) {
+	return _shadow_hits;
+}
+
+uint32_t lrphys::get_dma_aborts(void) {
+	return _dma_aborts;
+}
+
+void lrphys::shadow_invalidate(void) {
+	memset(_shadow_valid, 0, sizeof(_shadow_valid));
+}
+
+bool lrphys::shadow_lookup(uint8_t address, uint8_t *value) {
+	address &= 0x7f;
+	if (!lrphys_is_shadowed(address)
+			|| (_shadow_valid[address / 32] & (1UL << (address % 32))) == 0)
+		return false;
+
+	*value = _shadow[address];
+	return true;
+}
+
+void lrphys::shadow_store(uint8_t address, uint8_t value) {
+	address &= 0x7f;
+	if (!lrphys_is_shadowed(address))
+		return;
+
+	_shadow[address] = value;
+	_shadow_valid[address / 32] |= (1UL << (address % 32));
+}
+
+void lrphys::shadow_store(uint8_t address, const uint8_t *buffer, uint8_t size) {
+	address &= 0x7f;
+	if (address == LRPHYS_REG_FIFO)
+		return;
+
+	for (uint8_t i = 0; i < size; i++)
+		shadow_store(address + i, buffer[i]);
 }
 
 uint8_t lrphys::readRegister(uint8_t address) {
-	return singleTransfer(address & 0x7f, 0x00);
+	uint8_t value;
+
+	lock();
+	if (shadow_lookup(address, &value)) {
+		_shadow_hits++;
+	} else {
+		value = singleTransfer(address & 0x7f, 0x00);
+		shadow_store(address, value);
+	}
+	unlock();
+
+	return value;
 }
 
 void lrphys::writeRegister(uint8_t address, uint8_t value) {
-	singleTransfer(address | 0x80, value);
+	uint8_t cached;
+
+	lock();
+	if (shadow_lookup(address, &cached) && cached == value) {
+		_shadow_hits++;
+	} else {
+		singleTransfer(address | 0x80, value);
+		shadow_store(address, value);
+	}
+	unlock();
 }
 
 uint8_t lrphys::singleTransfer(uint8_t address, uint8_t value) {
-	uint8_t response, txdt;
+	uint8_t response;
+
+	if (_conf->transfer != NULL) {
+		_spi_transactions++;
+		_conf->transfer(_conf->transfer_arg, address, &value, &response, 1);
+		return response;
+	}
+
+	dma_wait_idle();
+
+	_spi_transactions++;
+
+	return _regio.exchange(address, value);
+}
+
+void lrphys::burstRead(uint8_t address, uint8_t *buffer, uint8_t size) {
+	uint8_t txdt = address & 0x7f;
+	lrphys_spi_op_t op = { txdt, buffer, size };
+
+	if (size == 0)
+		return;
+
+	lock();
+	if (_conf->transfer != NULL) {
+		_spi_transactions++;
+		_conf->transfer(_conf->transfer_arg, txdt, NULL, buffer, size);
+	} else if (size < LRPHYS_DMA_THRESHOLD || !dma_transfer_wait(&op)) {
+		dma_wait_idle();
+
+		_spi_transactions++;
+		_regio.burst_read(address, buffer, size);
+	}
+	shadow_store(address, buffer, size);
+	unlock();
+}
+
+void lrphys::burstWrite(uint8_t address, const uint8_t *buffer, uint8_t size) {
+	uint8_t txdt = address | 0x80;
+	lrphys_spi_op_t op = { txdt, (uint8_t*) buffer, size };
+
+	if (size == 0)
+		return;
+
+	lock();
+	shadow_store(address, buffer, size);
+
+	if (_conf->transfer != NULL) {
+		_spi_transactions++;
+		_conf->transfer(_conf->transfer_arg, txdt, buffer, NULL, size);
+	} else if (size < LRPHYS_DMA_THRESHOLD || !dma_transfer_wait(&op)) {
+		dma_wait_idle();
+
+		_spi_transactions++;
+		_regio.burst_write(address, buffer, size);
+	}
+	unlock();
+}
+
+
+
+/**
+ * DMA transport.
+ * Operations are chained from the SPI completion interrupt, CS is released
+ * between each of them. The callback runs in interrupt context.
+ */
+bool lrphys::submit_transfer(lrphys_spi_op_t *ops, uint8_t count,
+		lrphys_spi_cb_f callback, void *arg) {
+	if (ops == NULL || count == 0 || _conf->transfer != NULL
+			|| _conf->spi->hdmarx == NULL
+			|| _conf->spi->hdmatx == NULL)
+		return false;
+
+	UBaseType_t mask = taskENTER_CRITICAL_FROM_ISR();
+	if (_dma_busy) {
+		taskEXIT_CRITICAL_FROM_ISR(mask);
+		return false;
+	}
+	_dma_busy = true;
+	taskEXIT_CRITICAL_FROM_ISR(mask);
+
+	_dma_ops = ops;
+	_dma_count = count;
+	_dma_index = 0;
+	_dma_callback = callback;
+	_dma_arg = arg;
+
+	if (!dma_start_op()) {
+		_dma_busy = false;
+		return false;
+	}
+
+	return true;
+}
+
+bool lrphys::transfer_busy(void) {
+	return _dma_busy;
+}
+
+SPI_HandleTypeDef *lrphys::get_spi(void) {
+	return _conf->spi;
+}
+
+void lrphys::DMACompleteHandler(bool success) {
+	/** Aborted meanwhile, CS and the chain are no longer ours */
+	if (!_dma_busy)
+		return;
+
+	lrphys_spi_op_t *op = &_dma_ops[_dma_index];
 
+	HAL_GPIO_WritePin(_conf->cs_port, _conf->cs_pin, GPIO_PIN_SET);
+
+	if (success && (op->address & 0x80) == 0) {
+		SCB_InvalidateDCache_by_Addr((uint32_t*) _dma_rxbuf,
+				LRPHYS_DMA_BUFFER_SIZE);
+		memcpy(op->buffer, &_dma_rxbuf[1], op->size);
+	}
+
+	if (success && ++_dma_index < _dma_count) {
+		if (dma_start_op())
+			return;
+		success = false;
+	}
+
+	lrphys_spi_cb_f callback = _dma_callback;
+	void *arg = _dma_arg;
+
+	_dma_success = success;
+	_dma_busy = false;
+
+	if (callback != NULL)
+		callback(this, success, arg);
+}
+
+bool lrphys::dma_usable(void) {
+	return (_conf->transfer == NULL
+			&& _conf->spi->hdmarx != NULL && _conf->spi->hdmatx != NULL
+			&& _dma_done != NULL && !xPortIsInsideInterrupt()
+			&& xTaskGetSchedulerState() == taskSCHEDULER_RUNNING);
+}
+
+bool lrphys::dma_start_op(void) {
+	lrphys_spi_op_t *op = &_dma_ops[_dma_index];
+
+	_dma_txbuf[0] = op->address;
+	if (op->address & 0x80)
+		memcpy(&_dma_txbuf[1], op->buffer, op->size);
+	else
+		memset(&_dma_txbuf[1], 0x00, op->size);
+
+	/**
+	 * Bounce buffers live in cacheable AXI SRAM.
+	 */
+	SCB_CleanDCache_by_Addr((uint32_t*) _dma_txbuf, LRPHYS_DMA_BUFFER_SIZE);
+	SCB_InvalidateDCache_by_Addr((uint32_t*) _dma_rxbuf, LRPHYS_DMA_BUFFER_SIZE);
+
+	_spi_transactions++;
 	HAL_GPIO_WritePin(_conf->cs_port, _conf->cs_pin, GPIO_PIN_RESET);
 
-	txdt = address;
-	HAL_SPI_Transmit(_conf->spi, (uint8_t*) (&txdt), 1, 1000);
-	txdt = value;
-	HAL_SPI_TransmitReceive(_conf->spi, (uint8_t*) (&txdt),
-			(uint8_t*) (&response), 1, 1000);
+	if (HAL_SPI_TransmitReceive_DMA(_conf->spi, _dma_txbuf, _dma_rxbuf,
+			op->size + 1) != HAL_OK) {
+		HAL_GPIO_WritePin(_conf->cs_port, _conf->cs_pin, GPIO_PIN_SET);
+		return false;
+	}
+
+	return true;
+}
+
+bool lrphys::dma_transfer_wait(lrphys_spi_op_t *op) {
+	if (!dma_usable())
+		return false;
+
+	xSemaphoreTake(_dma_done, 0);
+
+	if (!submit_transfer(op, 1, lrphys_dma_release, (void*) _dma_done))
+		return false;
+
+	/**
+	 * Calling task blocks here, the other radio bus and the CPU keep going.
+	 */
+	if (xSemaphoreTake(_dma_done, pdMS_TO_TICKS(LRPHYS_DMA_TIMEOUT_MS))
+			!= pdTRUE) {
+		dma_abort();
+		return false;
+	}
+
+	return _dma_success;
+}
+
+/**
+ * Polled access waits out a chain in flight, at most LRPHYS_DMA_TIMEOUT_MS
+ * (HAL tick, counts before the scheduler too), then the chain is aborted.
+ */
+void lrphys::dma_wait_idle(void) {
+	uint32_t start = HAL_GetTick();
+
+	if (xPortIsInsideInterrupt())
+		return;
+
+	while (_dma_busy) {
+		if (HAL_GetTick() - start >= LRPHYS_DMA_TIMEOUT_MS) {
+			dma_abort();
+			break;
+		}
+	}
+}
+
+/**
+ * Stop a chain whose completion never came, counted in get_dma_aborts().
+ * The critical section masks the SPI and DMA interrupts (they give
+ * semaphores, so they sit under configMAX_SYSCALL_INTERRUPT_PRIORITY) and
+ * HAL_SPI_Abort() clears the flags a late completion would come from, so it
+ * cannot release CS or _dma_busy under the next transfer. The owner of the
+ * chain hears of the failure through its callback.
+ */
+void lrphys::dma_abort(void) {
+	UBaseType_t mask = taskENTER_CRITICAL_FROM_ISR();
 
+	if (!_dma_busy) {
+		taskEXIT_CRITICAL_FROM_ISR(mask);
+		return;
+	}
+
+	HAL_SPI_Abort(_conf->spi);
 	HAL_GPIO_WritePin(_conf->cs_port, _conf->cs_pin, GPIO_PIN_SET);
 
-	return response;
+	lrphys_spi_cb_f callback = _dma_callback;
+	void *arg = _dma_arg;
+
+	_dma_aborts++;
+	_dma_success = false;
+	_dma_busy = false;
+	taskEXIT_CRITICAL_FROM_ISR(mask);
+
+	if (callback != NULL)
+		callback(this, false, arg);
 }
 
+
+
+static void lrphys_dma_release(lrphys *phys, bool success, void *arg) {
+	BaseType_t woken = pdFALSE;
+	(void) phys;
+	(void) success;
+
+	xSemaphoreGiveFromISR((SemaphoreHandle_t) arg, &woken);
+	portYIELD_FROM_ISR(woken);
+}
+
+/**
+ * Registers that only change when written by the host.
+ */
+static bool lrphys_is_shadowed(uint8_t address) {
+	switch (address) {
+	case LRPHYS_REG_FRF_MSB:
+	case LRPHYS_REG_FRF_MID:
+	case LRPHYS_REG_FRF_LSB:
+	case LRPHYS_REG_PA_CONFIG:
+	case LRPHYS_REG_OCP:
+	case LRPHYS_REG_LNA:
+	case LRPHYS_REG_FIFO_TX_BASE_ADDR:
+	case LRPHYS_REG_FIFO_RX_BASE_ADDR:
+	case LRPHYS_REG_MODEM_CONFIG_1:
+	case LRPHYS_REG_MODEM_CONFIG_2:
+	case LRPHYS_REG_PREAMBLE_MSB:
+	case LRPHYS_REG_PREAMBLE_LSB:
+	case LRPHYS_REG_MODEM_CONFIG_3:
+	case LRPHYS_REG_DETECTION_OPTIMIZE:
+	case LRPHYS_REG_INVERTIQ:
+	case LRPHYS_REG_DETECTION_THRESHOLD:
+	case LRPHYS_REG_SYNC_WORD:
+	case LRPHYS_REG_INVERTIQ2:
+	case LRPHYS_REG_DIO_MAPPING_1:
+	case LRPHYS_REG_PA_DAC:
+		return true;
+	}
+
+	return false;
+}
+
+/**
+ * FREQ_ERROR_MSB..LSB to Hz, Ferr = raw * 2^24 / Fxtal * BW / 500 kHz
+ * (datasheet p. 37), integer only.
+ */
+static int32_t lrphys_freq_error_hz(const uint8_t *ferr, long bw) {
+	int32_t raw = ((int32_t) (ferr[0] & 0x07) << 16) | ((int32_t) ferr[1] << 8)
+			| ferr[2];
+
+	if (ferr[0] & 0x08)
+		raw -= 524288;
+
+	return (int32_t) (((int64_t) raw * bw * (1L << 24))
+			/ ((int64_t) 32000000 * 500000));
+}
+
+static uint8_t lrphys_bandwidth_index(long sbw) {
+	if (sbw <= 7800)
+		return 0;
+	else if (sbw <= 10400)
+		return 1;
+	else if (sbw <= 15600)
+		return 2;
+	else if (sbw <= 20800)
+		return 3;
+	else if (sbw <= 31250)
+		return 4;
+	else if (sbw <= 41700)
+		return 5;
+	else if (sbw <= 62500)
+		return 6;
+	else if (sbw <= 125000)
+		return 7;
+	else if (sbw <= 250000)
+		return 8;
+
+	return 9;
+}
+
+/**
+ * Register out of the RxDone snapshot burst starting at FIFO_RX_CURRENT_ADDR.
+ */
+static inline uint8_t lrphys_snap(const uint8_t *regs, uint8_t address) {
+	return regs[address - LRPHYS_REG_FIFO_RX_CURRENT_ADDR];
+}
+
+/**
+ * Per radio task: service the DIO interrupt notified by IRQHandler.
+ */
+static void lrphys_task_service_irq(void *param) {
+	lrphys *phys = (lrphys*) param;
+
+	while (1) {
+		uint32_t pending = ulTaskNotifyTake(pdTRUE, phys->get_service_timeout());
+
+		if (pending > 0)
+			phys->IRQProcess(pending);
+		else
+			phys->IRQTimeout();
+	}
+}
+
+static void lrphys_dma_dispatch(SPI_HandleTypeDef *hspi, bool success) {
+	for (int i = 0; i < LRPHYS_MAX_INSTANCES; i++) {
+		if (lrphys_instances[i] != NULL
+				&& lrphys_instances[i]->get_spi() == hspi
+				&& lrphys_instances[i]->transfer_busy()) {
+			lrphys_instances[i]->DMACompleteHandler(success);
+			break;
+		}
+	}
+}
+
+extern "C" void HAL_TIM_IC_CaptureCallback(TIM_HandleTypeDef *htim) {
+	for (int i = 0; i < LRPHYS_MAX_INSTANCES; i++) {
+		if (lrphys_instances[i] != NULL
+				&& lrphys_instances[i]->is_capture_source(htim)) {
+			lrphys_instances[i]->CaptureHandler();
+			break;
+		}
+	}
+}
+
+extern "C" void HAL_SPI_TxRxCpltCallback(SPI_HandleTypeDef *hspi) {
+	lrphys_dma_dispatch(hspi, true);
+}
+
+extern "C" void HAL_SPI_ErrorCallback(SPI_HandleTypeDef *hspi) {
+	lrphys_dma_dispatch(hspi, false);
+}
@@ -8,12 +8,18 @@
 #ifndef LORAWAN_LRPHYS_LRPHYS_H_
 #define LORAWAN_LRPHYS_LRPHYS_H_
 
+#include "lorawan/lrphys/lrphys_regio.h"
+#include "lorawan/lrphys/lrphys_spi.h"
+#include "lorawan/lrphys/lrphys_airtime.h"
 
 #ifdef __cplusplus
 extern "C"{
 #endif
 
 #include "stm32h7xx_hal.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include "semphr.h"
 #include "lorawan/lrphys/lrphys_macros.h"
 
 
@@ -28,6 +34,20 @@ typedef enum{
 
 typedef void(*lrphys_evtcb_f)(void *arg, lrphys_eventid_t id, uint8_t len);
 
+class lrphys;
+typedef void(*lrphys_spi_cb_f)(lrphys *phys, bool success, void *arg);
+typedef void(*lrphys_transfer_f)(void *arg, uint8_t address, const uint8_t *txbuf, uint8_t *rxbuf, uint8_t size);
+
+typedef struct{
+	/**
+	 * One CS-asserted register/FIFO burst, queued on the DMA transport.
+	 * Bit 7 of address selects write (1) or read (0).
+	 */
+	uint8_t address;
+	uint8_t *buffer;
+	uint8_t size;
+} lrphys_spi_op_t;
+
 typedef struct{
 	/**
 	 * Phys pin configure.
@@ -39,8 +59,76 @@ typedef struct{
 	uint16_t     rst_pin;
 	GPIO_TypeDef *io0_port;
 	uint16_t 	 io0_pin;
+	/**
+	 * Free running timer latched on DIO interrupt (optional).
+	 */
+	TIM_HandleTypeDef *tim;
+	/**
+	 * DIO0 wired to an input capture channel of tim (optional), the counter is
+	 * then latched by hardware instead of on EXTI entry. The pin has to be in
+	 * its timer alternate function.
+	 */
+	bool         tim_capture;
+	uint32_t     tim_channel;
+	/**
+	 * Transfer hook (optional), replaces the SPI bus, e.g. by the host model
+	 * test/sim/lrphys_sim.
+	 */
+	lrphys_transfer_f transfer;
+	void 			  *transfer_arg;
 } lrphys_hwconfig_t;
 
+typedef struct{
+	/**
+	 * Precomputed register image of a complete radio setting, the register
+	 * order is lrphys_profile_regs[] (ascending address).
+	 */
+	long    freq;
+	uint8_t implicit_header;
+	uint8_t value[LRPHYS_PROFILE_REGS];
+} lrphys_profile_t;
+
+typedef struct{
+	uint32_t irq_count;       /** DIO interrupts taken */
+	uint32_t irq_coalesced;   /** Interrupts folded into a previous service run */
+	uint32_t isr_cycles_last; /** CPU cycles spent in IRQHandler */
+	uint32_t isr_cycles_max;
+	uint32_t latency_us_last; /** Notify to service task latency */
+	uint32_t latency_us_max;
+} lrphys_irq_stats_t;
+
+typedef struct{
+	/**
+	 * Received frame metadata, captured in one burst at RxDone.
+	 */
+	uint32_t tmst;       /** Timer counter latched at RxDone */
+	long     freq;       /** Hz, frequency the modem was tuned to */
+	int32_t  freq_error; /** Hz */
+	int16_t  rssi;       /** dBm */
+	int8_t   snr;        /** 0.25 dB steps */
+	uint8_t  sf;
+	uint16_t bw;         /** kHz */
+	uint8_t  cr;         /** Coding rate 4/cr */
+	uint8_t  length;
+} lrphys_rx_meta_t;
+
+typedef struct{
+	uint32_t frames;      /** RxDone taken, CRC errors included */
+	uint32_t crc_errors;
+	uint32_t overruns;    /** Frames lost, not starting where the previous one ended */
+	uint32_t overwritten; /** Payload overwritten by the next frame before drained */
+} lrphys_rx_stats_t;
+
+typedef struct{
+	/**
+	 * Indexed by spreading factor - LRPHYS_CAD_SF_MIN.
+	 */
+	uint32_t cad_done[LRPHYS_CAD_SF_COUNT];     /** CAD cycles run */
+	uint32_t cad_detected[LRPHYS_CAD_SF_COUNT]; /** Preamble detected, receiver locked */
+	uint32_t hits[LRPHYS_CAD_SF_COUNT];         /** Lock ended with a received frame */
+	uint32_t misses[LRPHYS_CAD_SF_COUNT];       /** Lock ended by timeout or CRC error */
+} lrphys_cad_stats_t;
+
 
 
 class lrphys{
@@ -49,23 +137,33 @@ class lrphys{
 
 		bool initialize(lrphys_hwconfig_t *conf = NULL);
 		void stop(void);
+		void lock(void);
+		void unlock(void);
 		void register_event_handler(lrphys_evtcb_f event_handler_function = NULL, void *parameter = NULL);
 
 		void set_mode_receive_it(uint8_t size);
+		void set_mode_cad_scan(uint8_t sf_min = LRPHYS_CAD_SF_MIN, uint8_t sf_max = LRPHYS_CAD_SF_MAX);
+		bool is_cad_scanning(void);
+		bool is_receiving(void);
+		bool is_rx_locked(void);
+		void get_cad_stats(lrphys_cad_stats_t *stats);
+		void reset_cad_stats(void);
+		void get_rx_stats(lrphys_rx_stats_t *stats);
+		void reset_rx_stats(void);
 		int16_t rssi(void);
 
 		bool packet_begin(bool implicitHeader = false);
 		bool packet_end(bool async = false);
 		uint8_t packet_parse(uint8_t size = 0);
 		int packet_rssi(void);
-		float packet_snr(void);
+		int8_t packet_snr(void);
 		long packet_freq_error(void);
 
 		size_t transmit(uint8_t byte);
 		size_t transmit(const uint8_t *buffer, size_t size);
 
 		uint8_t available(void);
-		uint8_t receive(char *buffer);
+		uint8_t receive(char *buffer, uint8_t size = LRPHYS_MAX_PKT_LENGTH);
 		uint8_t peek(void);
 
 		void idle(void);
@@ -81,12 +179,38 @@ class lrphys{
 		void set_ocp(uint8_t mA);
 		void set_gain(uint8_t gain);
 
+		static void build_profile(lrphys_profile_t *profile, long frequency, uint8_t power,
+				uint8_t sf, long sbw, uint8_t denominator, long preamble, uint8_t sw,
+				bool crc = true, bool invertIQ = false, bool implicitHeader = false);
+		void apply_profile(const lrphys_profile_t *profile);
+
 		void enable_crc(void);
 		void disable_crc(void);
 		void enable_invertIQ(void);
 		void disable_invertIQ(void);
 
 		void IRQHandler(void);
+		void CaptureHandler(void);
+		bool is_capture_source(TIM_HandleTypeDef *htim);
+		void IRQProcess(uint32_t pending = 1);
+		void IRQTimeout(void);
+		TickType_t get_service_timeout(void);
+		uint32_t get_irq_timestamp(void);
+		uint32_t get_rx_timestamp(void);
+		void get_rx_meta(lrphys_rx_meta_t *meta);
+		void get_irq_stats(lrphys_irq_stats_t *stats);
+		void reset_irq_stats(void);
+
+		uint32_t get_spi_transactions(void);
+		void reset_spi_transactions(void);
+		uint32_t get_shadow_hits(void);
+		void shadow_invalidate(void);
+		uint32_t get_dma_aborts(void);
+
+		bool submit_transfer(lrphys_spi_op_t *ops, uint8_t count, lrphys_spi_cb_f callback = NULL, void *arg = NULL);
+		bool transfer_busy(void);
+		void DMACompleteHandler(bool success);
+		SPI_HandleTypeDef *get_spi(void);
 
 
 	protected:
@@ -94,6 +218,9 @@ class lrphys{
 		void writeRegister(uint8_t address, uint8_t value);
 		uint8_t singleTransfer(uint8_t address, uint8_t value);
 
+		void burstRead(uint8_t address, uint8_t *buffer, uint8_t size);
+		void burstWrite(uint8_t address, const uint8_t *buffer, uint8_t size);
+
 	private:
 		void explicitHeaderMode(void);
 		void implicitHeaderMode(void);
@@ -105,7 +232,27 @@ class lrphys{
 
 		void set_LDO_flag(void);
 
+		void irq_latch(uint32_t timestamp);
+
+		uint8_t rx_capture(uint32_t pending);
+		void rx_track(uint8_t start, uint8_t length, uint32_t pending);
+
+		void cad_start(uint8_t sf);
+		void cad_done(uint8_t irqFlags);
+		void cad_unlock(bool hit);
+
+		bool shadow_lookup(uint8_t address, uint8_t *value);
+		void shadow_store(uint8_t address, uint8_t value);
+		void shadow_store(uint8_t address, const uint8_t *buffer, uint8_t size);
+
+		bool dma_usable(void);
+		bool dma_start_op(void);
+		bool dma_transfer_wait(lrphys_spi_op_t *op);
+		void dma_wait_idle(void);
+		void dma_abort(void);
+
 		lrphys_hwconfig_t *_conf;
+		lrphys_regio<lrphys_spi> _regio;
 
 		lrphys_evtcb_f    _event_handler = NULL;
 		void 			  *_event_parameter = NULL;
@@ -114,6 +261,70 @@ class lrphys{
 		int 		 	  _packetIndex = 0;
 		int 			  _implicitHeaderMode = 0;
 
+		/**
+		 * Radio ownership across tasks, recursive.
+		 */
+		SemaphoreHandle_t _lock = NULL;
+
+		/**
+		 * Number of CS-asserted SPI transactions issued to the chip.
+		 */
+		uint32_t 		  _spi_transactions = 0;
+
+		/**
+		 * Deferred interrupt state, IRQHandler only latches and notifies.
+		 */
+		TaskHandle_t 	   _service_task = NULL;
+		volatile uint32_t  _irq_timestamp = 0;
+		uint32_t 		   _rx_timestamp = 0;
+		volatile uint32_t  _irq_cycles = 0;
+		lrphys_irq_stats_t _irq_stats = {0, 0, 0, 0, 0, 0};
+
+		/**
+		 * RX continuous FIFO bookkeeping, frames are written back to back and
+		 * wrap at the end of the 256 byte FIFO.
+		 */
+		uint8_t 		   _rx_start = 0;
+		uint8_t 		   _rx_length = 0;
+		uint8_t 		   _rx_next_addr = 0;
+		bool 			   _rx_next_valid = false;
+		lrphys_rx_stats_t  _rx_stats = {0, 0, 0, 0};
+		lrphys_rx_meta_t   _rx_meta = {0, 0, 0, 0, 0, 0, 0, 0, 0};
+
+		/**
+		 * CAD scan state, stepped from the service task.
+		 */
+		bool 			   _cad_scan = false;
+		bool 			   _cad_locked = false;
+		uint8_t 		   _cad_sf_min = LRPHYS_CAD_SF_MIN;
+		uint8_t 		   _cad_sf_max = LRPHYS_CAD_SF_MAX;
+		uint8_t 		   _cad_sf = LRPHYS_CAD_SF_MIN;
+		uint8_t 		   _cad_extensions = 0;
+		lrphys_cad_stats_t _cad_stats = {{0}, {0}, {0}, {0}};
+
+		/**
+		 * Write-through copy of the configuration registers, invalidated on
+		 * reset and sleep. Volatile status registers are never shadowed.
+		 */
+		uint8_t 		  _shadow[LRPHYS_SHADOW_SIZE];
+		uint32_t 		  _shadow_valid[(LRPHYS_SHADOW_SIZE + 31) / 32] = {0};
+		uint32_t 		  _shadow_hits = 0;
+
+		/**
+		 * DMA transport state, one queue of operations in flight per chip.
+		 */
+		lrphys_spi_op_t   *_dma_ops = NULL;
+		uint8_t 		  _dma_count = 0;
+		uint8_t 		  _dma_index = 0;
+		lrphys_spi_cb_f   _dma_callback = NULL;
+		void 			  *_dma_arg = NULL;
+		volatile bool     _dma_busy = false;
+		volatile bool     _dma_success = false;
+		uint32_t 		  _dma_aborts = 0;  /** Chains stopped after LRPHYS_DMA_TIMEOUT_MS */
+		SemaphoreHandle_t _dma_done = NULL;
+		uint8_t 		  _dma_txbuf[LRPHYS_DMA_BUFFER_SIZE] __attribute__((aligned(32)));
+		uint8_t 		  _dma_rxbuf[LRPHYS_DMA_BUFFER_SIZE] __attribute__((aligned(32)));
+
 };
 
 
@@ -0,0 +1,71 @@
+/*
+ * lrphys_airtime.h
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: anh
+ */
+
+#ifndef LORAWAN_LRPHYS_LRPHYS_AIRTIME_H_
+#define LORAWAN_LRPHYS_LRPHYS_AIRTIME_H_
+
+#include "stdint.h"
+
+
+/**
+ * LoRa time on air (Semtech AN1200.13 / SX1276 datasheet 4.1.1.7), integer only.
+ * Times are computed in ns from the exact symbol period 2^SF / BW and returned
+ * in us, all functions fold to constants when their arguments are constant.
+ *
+ * sf 6..12, bw in Hz, cr is the coding rate denominator 5..8 (4/5..4/8).
+ */
+extern "C++" {
+
+constexpr uint64_t lrphys_airtime_symbol_ns(uint8_t sf, uint32_t bw){
+	return ((uint64_t)1000000000UL << sf) / bw;
+}
+
+/**
+ * Low data rate optimization, mandated above 16 ms symbols as in lrphys::set_LDO_flag().
+ */
+constexpr bool lrphys_airtime_ldro(uint8_t sf, uint32_t bw){
+	return lrphys_airtime_symbol_ns(sf, bw) > 16000000UL;
+}
+
+constexpr uint32_t lrphys_airtime_payload_symbols(uint8_t size, uint8_t sf, uint8_t cr,
+		bool crc, bool implicit_header, bool ldro){
+	int32_t num = 8 * (int32_t)size - 4 * (int32_t)sf + 28 + (crc ? 16 : 0) - (implicit_header ? 20 : 0);
+	int32_t den = 4 * ((int32_t)sf - (ldro ? 2 : 0));
+
+	return 8 + ((num > 0) ? (uint32_t)((num + den - 1) / den) * cr : 0);
+}
+
+constexpr uint32_t lrphys_airtime_preamble_us(uint8_t sf, uint32_t bw, uint16_t preamble = 8){
+	return (uint32_t)(((4 * (uint64_t)preamble + 17) * lrphys_airtime_symbol_ns(sf, bw)) / 4 / 1000);
+}
+
+constexpr uint32_t lrphys_airtime_ldro_us(uint8_t size, uint8_t sf, uint32_t bw, uint8_t cr,
+		uint16_t preamble, bool crc, bool implicit_header, bool ldro){
+	return (uint32_t)((((4 * (uint64_t)preamble + 17) * lrphys_airtime_symbol_ns(sf, bw)) / 4
+			+ lrphys_airtime_payload_symbols(size, sf, cr, crc, implicit_header, ldro)
+					* lrphys_airtime_symbol_ns(sf, bw)) / 1000);
+}
+
+constexpr uint32_t lrphys_airtime_us(uint8_t size, uint8_t sf, uint32_t bw, uint8_t cr = 5,
+		uint16_t preamble = 8, bool crc = true, bool implicit_header = false){
+	return lrphys_airtime_ldro_us(size, sf, bw, cr, preamble, crc, implicit_header,
+			lrphys_airtime_ldro(sf, bw));
+}
+
+/**
+ * Reference points, AN1200.13 formula evaluated in floating point.
+ */
+static_assert(lrphys_airtime_us(10, 7, 125000) == 41216, "SF7BW125 10 bytes");
+static_assert(lrphys_airtime_us(51, 12, 125000) == 2465792, "SF12BW125 51 bytes, LDRO");
+static_assert(lrphys_airtime_us(51, 10, 125000) == 616448, "SF10BW125 51 bytes");
+static_assert(lrphys_airtime_us(222, 7, 125000) == 348416, "SF7BW125 222 bytes");
+static_assert(lrphys_airtime_us(13, 9, 500000, 5, 8, false) == 36096, "SF9BW500 13 bytes, no CRC");
+
+}
+
+
+#endif /* LORAWAN_LRPHYS_LRPHYS_AIRTIME_H_ */
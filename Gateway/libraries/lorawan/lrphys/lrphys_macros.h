@@ -28,6 +28,7 @@
 #define LRPHYS_REG_RX_NB_BYTES          0x13
 #define LRPHYS_REG_PKT_SNR_VALUE        0x19
 #define LRPHYS_REG_PKT_RSSI_VALUE       0x1a
+#define LRPHYS_REG_MODEM_STAT           0x18
 #define LRPHYS_REG_RSSI_VALUE           0x1b
 #define LRPHYS_REG_MODEM_CONFIG_1       0x1d
 #define LRPHYS_REG_MODEM_CONFIG_2       0x1e
@@ -35,6 +36,7 @@
 #define LRPHYS_REG_PREAMBLE_LSB         0x21
 #define LRPHYS_REG_PAYLOAD_LENGTH       0x22
 #define LRPHYS_REG_MODEM_CONFIG_3       0x26
+#define LRPHYS_REG_FIFO_RX_BYTE_ADDR    0x25
 #define LRPHYS_REG_FREQ_ERROR_MSB       0x28
 #define LRPHYS_REG_FREQ_ERROR_MID       0x29
 #define LRPHYS_REG_FREQ_ERROR_LSB       0x2a
@@ -58,6 +60,7 @@
 #define LRPHYS_MODE_TX                  0x03
 #define LRPHYS_MODE_RX_CONTINUOUS       0x05
 #define LRPHYS_MODE_RX_SINGLE           0x06
+#define LRPHYS_MODE_CAD                 0x07
 
 /** Group: PA boost.
  * LoRa Physical pa boost.
@@ -67,14 +70,28 @@
 /** Group: IRQ mask.
  * LoRa Physical irq mask.
  */
+#define LRPHYS_IRQ_CAD_DETECTED_MASK      0x01
+#define LRPHYS_IRQ_CAD_DONE_MASK          0x04
 #define LRPHYS_IRQ_TX_DONE_MASK           0x08
 #define LRPHYS_IRQ_PAYLOAD_CRC_ERROR_MASK 0x20
 #define LRPHYS_IRQ_RX_DONE_MASK           0x40
 
+/** Group: DIO mapping.
+ * LoRa Physical DIO0 source, DIO_MAPPING_1 bits 7:6.
+ */
+#define LRPHYS_DIO0_RX_DONE               0x00
+#define LRPHYS_DIO0_TX_DONE               0x40
+#define LRPHYS_DIO0_CAD_DONE              0x80
+
+/** Group: Modem status.
+ * LoRa Physical modem status, signal detected/synchronized/header valid.
+ */
+#define LRPHYS_MODEM_STAT_RX_ONGOING      0x0b
+
 /** Group: Specification.
  * LoRa Physical specification.
  */
-#define LRPHYS_RF_MID_BAND_THRESHOLD      525E6
+#define LRPHYS_RF_MID_BAND_THRESHOLD      525000000L
 #define LRPHYS_RSSI_OFFSET_HF_PORT        157
 #define LRPHYS_RSSI_OFFSET_LF_PORT        164
 #define LRPHYS_MAX_PKT_LENGTH                       255
@@ -85,5 +102,49 @@
 #define LRPHYS_PA_OUTPUT_RFO_PIN          0
 #define LRPHYS_PA_OUTPUT_PA_BOOST_PIN     1
 
+/** Group: Register shadow.
+ * LoRa Physical configuration register shadow, covers 0x00..LRPHYS_REG_PA_DAC.
+ */
+#define LRPHYS_SHADOW_SIZE                (LRPHYS_REG_PA_DAC + 1)
+
+/** Group: Radio profile.
+ * LoRa Physical number of registers in a precomputed profile image.
+ */
+#define LRPHYS_PROFILE_REGS               16
+
+/** Group: DMA transport.
+ * LoRa Physical SPI DMA transport.
+ */
+#define LRPHYS_DMA_THRESHOLD              8   /** Burst size from which DMA is used instead of polling */
+#define LRPHYS_DMA_BUFFER_SIZE            288 /** Address byte + max packet, rounded up to cache line  */
+#define LRPHYS_DMA_TIMEOUT_MS             100
+#define LRPHYS_MAX_INSTANCES              8
+
+/** Group: SPI transport.
+ * LoRa Physical polled SPI transport.
+ */
+#define LRPHYS_SPI_FIFO_DEPTH             8      /** Bytes in flight, SPI4 has the smallest FIFO */
+#define LRPHYS_SPI_SPIN_LIMIT             100000 /** Status polls before a transfer is abandoned */
+
+/** Group: RX snapshot.
+ * LoRa Physical registers read in one burst at RxDone, FIFO_RX_CURRENT_ADDR..FREQ_ERROR_LSB.
+ */
+#define LRPHYS_RX_SNAPSHOT_SIZE           (LRPHYS_REG_FREQ_ERROR_LSB - LRPHYS_REG_FIFO_RX_CURRENT_ADDR + 1)
+
+/** Group: CAD scan.
+ * LoRa Physical multi spreading factor reception by channel activity detection.
+ */
+#define LRPHYS_CAD_SF_MIN                 7
+#define LRPHYS_CAD_SF_MAX                 12
+#define LRPHYS_CAD_SF_COUNT               (LRPHYS_CAD_SF_MAX - LRPHYS_CAD_SF_MIN + 1)
+#define LRPHYS_CAD_LOCK_SYMBOLS           32 /** Symbols after detection before checking the modem status */
+#define LRPHYS_CAD_LOCK_EXTENSIONS        16 /** Checks a frame in progress may hold the lock for */
+
+/** Group: IRQ service.
+ * LoRa Physical deferred interrupt service task.
+ */
+#define LRPHYS_SERVICE_TASK_PRIORITY      12
+#define LRPHYS_SERVICE_TASK_STACK_SIZE    2048
+
 
 #endif /* LORAWAN_LRPHYS_LRPHYS_MACROS_H_ */
@@ -0,0 +1,60 @@
+/*
+ * lrphys_regio.h
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: anh
+ */
+
+#ifndef LORAWAN_LRPHYS_LRPHYS_REGIO_H_
+#define LORAWAN_LRPHYS_LRPHYS_REGIO_H_
+
+#include "stdint.h"
+#include "stddef.h"
+
+
+/**
+ * SX127x register and burst access over a compile-time transport.
+ * Everything inlines into the caller, there is no HAL or RTOS dependency so
+ * the same template instantiates on the target (lrphys_spi) and on the host
+ * (lrphys_sim_transport, test/sim).
+ *
+ * Transport requirement, one CS-asserted transaction, either buffer may be NULL:
+ *   bool transfer(uint8_t address, const uint8_t *txbuf, uint8_t *rxbuf, uint8_t size);
+ * Kept C++ linkage, lrphys.h is pulled in from extern "C" blocks.
+ */
+extern "C++" {
+
+template<class Transport>
+class lrphys_regio{
+	public:
+		Transport transport;
+
+		inline uint8_t exchange(uint8_t address, uint8_t value){
+			uint8_t response = 0x00;
+
+			transport.transfer(address, &value, &response, 1);
+
+			return response;
+		}
+
+		inline uint8_t read(uint8_t address){
+			return exchange(address & 0x7f, 0x00);
+		}
+
+		inline void write(uint8_t address, uint8_t value){
+			exchange(address | 0x80, value);
+		}
+
+		inline bool burst_read(uint8_t address, uint8_t *buffer, uint8_t size){
+			return transport.transfer(address & 0x7f, NULL, buffer, size);
+		}
+
+		inline bool burst_write(uint8_t address, const uint8_t *buffer, uint8_t size){
+			return transport.transfer(address | 0x80, buffer, NULL, size);
+		}
+};
+
+}
+
+
+#endif /* LORAWAN_LRPHYS_LRPHYS_REGIO_H_ */
@@ -0,0 +1,76 @@
+/*
+ * lrphys_spi.h
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: anh
+ */
+
+#ifndef LORAWAN_LRPHYS_LRPHYS_SPI_H_
+#define LORAWAN_LRPHYS_LRPHYS_SPI_H_
+
+#include "stm32h7xx_hal.h"
+#include "lorawan/lrphys/lrphys_macros.h"
+
+
+/**
+ * STM32H7 SPI polled transport for lrphys_regio.
+ * Drives the peripheral registers directly (the bus has already been set up
+ * by HAL_SPI_Init), CS through BSRR, one TSIZE-bounded transfer per call.
+ */
+class lrphys_spi{
+	public:
+		inline void attach(SPI_TypeDef *spi, GPIO_TypeDef *cs_port, uint16_t cs_pin){
+			_spi = spi;
+			_cs_port = cs_port;
+			_cs_pin = cs_pin;
+		}
+
+		inline bool transfer(uint8_t address, const uint8_t *txbuf, uint8_t *rxbuf, uint8_t size){
+			SPI_TypeDef *spi = _spi;
+			uint16_t total = (uint16_t)size + 1;
+			uint16_t txn = 0, rxn = 0;
+			uint32_t spin = LRPHYS_SPI_SPIN_LIMIT;
+
+			_cs_port->BSRR = (uint32_t)_cs_pin << 16;
+
+			MODIFY_REG(spi->CR2, SPI_CR2_TSIZE, total);
+			spi->CR1 |= SPI_CR1_SPE;
+			spi->CR1 |= SPI_CR1_CSTART;
+
+			while (rxn < total) {
+				uint32_t sr = spi->SR;
+
+				if (txn < total && (sr & SPI_SR_TXP) && (uint16_t)(txn - rxn) < LRPHYS_SPI_FIFO_DEPTH) {
+					*(__IO uint8_t*)&spi->TXDR = (txn == 0) ? address : ((txbuf != NULL) ? txbuf[txn - 1] : 0x00);
+					txn++;
+				}
+				if (sr & SPI_SR_RXP) {
+					uint8_t data = *(__IO uint8_t*)&spi->RXDR;
+
+					if (rxn > 0 && rxbuf != NULL)
+						rxbuf[rxn - 1] = data;
+					rxn++;
+				}
+				if (--spin == 0)
+					break;
+			}
+
+			while (spin != 0 && !(spi->SR & SPI_SR_EOT))
+				spin--;
+
+			spi->IFCR = SPI_IFCR_EOTC | SPI_IFCR_TXTFC | SPI_IFCR_OVRC;
+			spi->CR1 &= ~SPI_CR1_SPE;
+
+			_cs_port->BSRR = _cs_pin;
+
+			return (spin != 0);
+		}
+
+	private:
+		SPI_TypeDef  *_spi = NULL;
+		GPIO_TypeDef *_cs_port = NULL;
+		uint16_t      _cs_pin = 0;
+};
+
+
+#endif /* LORAWAN_LRPHYS_LRPHYS_SPI_H_ */
@@ -8,6 +8,7 @@
 #include "gpio.h"
 #include "spi.h"
 #include "rtc.h"
+#include "tim.h"
 
 #include "stdio.h"
 #include "string.h"
@@ -47,7 +48,8 @@ lrphys_hwconfig_t lora_ch0_hw = {
 	.rst_port = LORA1_RST_GPIO_Port,
 	.rst_pin  = LORA1_RST_Pin,
 	.io0_port = LORA1_IO0_GPIO_Port,
-	.io0_pin  = LORA1_IO0_Pin
+	.io0_pin  = LORA1_IO0_Pin,
+	.tim      = &htim2
 };
 
 lrphys lora_ch1;
@@ -58,7 +60,8 @@ lrphys_hwconfig_t lora_ch1_hw = {
 	.rst_port = LORA2_RST_GPIO_Port,
 	.rst_pin  = LORA2_RST_Pin,
 	.io0_port = LORA2_IO0_GPIO_Port,
-	.io0_pin  = LORA2_IO0_Pin
+	.io0_pin  = LORA2_IO0_Pin,
+	.tim      = &htim2
 };
 
 void ethernet_link_event_handler(ethernet_event_t event);
@@ -0,0 +1,173 @@
+/*
+ * bench_lrmac_ring.cpp
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: anh
+ */
+
+#include "lorawan/lrmac/lrmac_ring.h"
+#include "lorawan/gateway/gateway_downlink.h"
+#include "host_test.h"
+
+#include "string.h"
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+
+/**
+ * Stress of the two lock-free structures on the uplink and downlink path, on
+ * real host threads rather than the single core they run on in the firmware,
+ * so every interleaving the memory orders allow is exercised.
+ * lrmac_ring: one producer, one consumer, every frame must come out once, in
+ * order and intact. lrwgw_downlink: several threads allocating and freeing,
+ * no descriptor may be handed out twice and none may leak.
+ */
+#define BENCH_RING_DEPTH     8U
+#define BENCH_RING_FRAMES    2000000U
+#define BENCH_POOL_THREADS   4U
+#define BENCH_POOL_ROUNDS    500000U
+
+typedef std::chrono::steady_clock bench_clock;
+
+static lrmac_ring_entry_t ring_entry[BENCH_RING_DEPTH];
+static lrmac_ring_t ring;
+
+static uint8_t frame_byte(uint32_t seq, uint8_t i){
+	return (uint8_t)(seq * 31U + i);
+}
+
+static void ring_producer(void){
+	for(uint32_t seq=0; seq<BENCH_RING_FRAMES; seq++){
+		lrmac_packet_t *pkt;
+
+		while((pkt = lrmac_ring_reserve(&ring)) == NULL) std::this_thread::yield();
+
+		pkt->payload_size = (uint8_t)(1U + seq % LRPHYS_MAX_PKT_LENGTH);
+		memcpy(pkt->payload, &seq, sizeof(seq));
+		for(uint8_t i=sizeof(seq); i<pkt->payload_size; i++) pkt->payload[i] = frame_byte(seq, i);
+		pkt->channel = (uint8_t)seq;
+
+		lrmac_ring_commit(&ring);
+	}
+}
+
+static void bench_ring(void){
+	uint32_t out_of_order = 0, corrupt = 0;
+	lrmac_ring_stats_t stats;
+
+	HOST_CHECK(lrmac_ring_attach(&ring, ring_entry, BENCH_RING_DEPTH));
+	HOST_CHECK(!lrmac_ring_attach(&ring, ring_entry, 6));
+	HOST_CHECK(lrmac_ring_attach(&ring, ring_entry, BENCH_RING_DEPTH));
+
+	bench_clock::time_point start = bench_clock::now();
+	std::thread producer(ring_producer);
+
+	for(uint32_t expect=0; expect<BENCH_RING_FRAMES; expect++){
+		lrmac_packet_t *pkt;
+		uint32_t seq = 0;
+
+		while((pkt = lrmac_ring_peek(&ring)) == NULL) std::this_thread::yield();
+
+		uint8_t size = (uint8_t)(1U + expect % LRPHYS_MAX_PKT_LENGTH);
+		memcpy(&seq, pkt->payload, sizeof(seq));
+		if(seq != expect || pkt->channel != (uint8_t)expect) out_of_order++;
+		if(pkt->payload_size != size) corrupt++;
+		else for(uint8_t i=sizeof(seq); i<size; i++){
+			if(pkt->payload[i] != frame_byte(expect, i)){
+				corrupt++;
+				break;
+			}
+		}
+
+		lrmac_ring_release(&ring);
+	}
+	producer.join();
+
+	double seconds = std::chrono::duration<double>(bench_clock::now() - start).count();
+	stats = ring.stats;
+
+	HOST_CHECK_EQ(out_of_order, 0);
+	HOST_CHECK_EQ(corrupt, 0);
+	HOST_CHECK_EQ(stats.pushed, BENCH_RING_FRAMES);
+	HOST_CHECK(stats.high_water <= BENCH_RING_DEPTH);
+	HOST_CHECK_EQ(lrmac_ring_count(&ring), 0);
+	HOST_CHECK(lrmac_ring_peek(&ring) == NULL);
+
+	printf("lrmac_ring:     %u frames in %.3f s, %.0f frames/s, producer found it full %u times, high water %u/%u\n",
+			(unsigned)BENCH_RING_FRAMES, seconds, BENCH_RING_FRAMES / seconds,
+			(unsigned)stats.dropped, (unsigned)stats.high_water, (unsigned)stats.depth);
+}
+
+static std::atomic<uint32_t> pool_double_owned(0);
+
+static void pool_worker(uint16_t id){
+	std::vector<lrwgw_downlink_t *> held;
+
+	for(uint32_t round=0; round<BENCH_POOL_ROUNDS; round++){
+		/** Hold a few descriptors at once so the free list is often near empty */
+		if(held.size() < 3){
+			lrwgw_downlink_t *dl = lrwgw_downlink_alloc();
+			if(dl != NULL){
+				if(dl->token != 0 || dl->packet.payload != dl->data) pool_double_owned++;
+				dl->token = id;
+				dl->length = (uint16_t)round;
+				held.push_back(dl);
+				continue;
+			}
+		}
+		if(!held.empty()){
+			lrwgw_downlink_t *dl = held.front();
+			if(dl->token != id) pool_double_owned++;
+			held.erase(held.begin());
+			lrwgw_downlink_free(dl);
+		}
+	}
+	for(lrwgw_downlink_t *dl : held){
+		if(dl->token != id) pool_double_owned++;
+		lrwgw_downlink_free(dl);
+	}
+}
+
+static void bench_downlink_pool(void){
+	std::vector<std::thread> worker;
+	lrwgw_downlink_stats_t stats;
+	lrwgw_downlink_t *all[LRWGW_DOWNLINK_POOL_SIZE + 1];
+
+	lrwgw_downlink_initialize();
+
+	bench_clock::time_point start = bench_clock::now();
+	for(uint16_t id=1; id<=BENCH_POOL_THREADS; id++) worker.emplace_back(pool_worker, id);
+	for(std::thread &t : worker) t.join();
+	double seconds = std::chrono::duration<double>(bench_clock::now() - start).count();
+
+	lrwgw_downlink_get_stats(&stats);
+	HOST_CHECK_EQ(pool_double_owned.load(), 0);
+	HOST_CHECK_EQ(stats.allocs, stats.frees);
+	HOST_CHECK_EQ(stats.in_use, 0);
+	HOST_CHECK(stats.in_use_max <= LRWGW_DOWNLINK_POOL_SIZE);
+	HOST_CHECK_EQ(stats.invalid_free, 0);
+
+	printf("lrwgw_downlink: %u alloc/free in %.3f s on %u threads, %.0f ops/s, exhausted %u times\n",
+			(unsigned)(stats.allocs + stats.frees), seconds, (unsigned)BENCH_POOL_THREADS,
+			(stats.allocs + stats.frees) / seconds, (unsigned)stats.exhausted);
+
+	/** Nothing leaked: every slot comes back, then the pool is empty */
+	for(uint16_t i=0; i<=LRWGW_DOWNLINK_POOL_SIZE; i++) all[i] = lrwgw_downlink_alloc();
+	for(uint16_t i=0; i<LRWGW_DOWNLINK_POOL_SIZE; i++) HOST_CHECK(all[i] != NULL);
+	HOST_CHECK(all[LRWGW_DOWNLINK_POOL_SIZE] == NULL);
+	for(uint16_t i=0; i<LRWGW_DOWNLINK_POOL_SIZE; i++) lrwgw_downlink_free(all[i]);
+
+	lrwgw_downlink_free((lrwgw_downlink_t *)((uint8_t *)all[0] + 1));
+	lrwgw_downlink_get_stats(&stats);
+	HOST_CHECK_EQ(stats.invalid_free, 1);
+	HOST_CHECK_EQ(stats.in_use, 0);
+}
+
+int main(void){
+	bench_ring();
+	bench_downlink_pool();
+
+	return HOST_TEST_RESULT();
+}
@@ -0,0 +1,49 @@
+/*
+ * FreeRTOS.h
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: anh
+ */
+
+#ifndef HOST_FREERTOS_H_
+#define HOST_FREERTOS_H_
+
+/**
+ * Host stand-in for the FreeRTOS kernel API lrphys and lrmac use. There is no
+ * scheduler, the test drives the service work itself, see host_rtos.h.
+ */
+#include "stdint.h"
+#include "stddef.h"
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+typedef long          BaseType_t;
+typedef unsigned long UBaseType_t;
+typedef uint32_t      TickType_t;
+typedef uint32_t      StackType_t;
+
+#define pdFALSE              ((BaseType_t)0)
+#define pdTRUE               ((BaseType_t)1)
+#define pdPASS               pdTRUE
+#define pdFAIL               pdFALSE
+#define portMAX_DELAY        ((TickType_t)0xffffffffUL)
+#define configTICK_RATE_HZ   1000U
+#define pdMS_TO_TICKS(ms)    ((TickType_t)(((TickType_t)(ms) * configTICK_RATE_HZ) / 1000U))
+
+#define portYIELD_FROM_ISR(x)          ((void)(x))
+#define taskENTER_CRITICAL()
+#define taskEXIT_CRITICAL()
+#define taskENTER_CRITICAL_FROM_ISR()  ((UBaseType_t)0)
+#define taskEXIT_CRITICAL_FROM_ISR(x)  ((void)(x))
+
+BaseType_t xPortIsInsideInterrupt(void);
+void *pvPortMalloc(size_t size);
+void vPortFree(void *pv);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* HOST_FREERTOS_H_ */
@@ -0,0 +1,236 @@
+/*
+ * host_rtos.cpp
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: anh
+ */
+
+#include "stm32h7xx_hal.h"
+#include "host_rtos.h"
+
+#include "stdio.h"
+#include "stdlib.h"
+
+
+#define HOST_TASK_MAX      16
+#define HOST_SEMAPHORE_MAX 32
+
+struct host_task{
+	void     *param;
+	uint32_t notify;
+};
+
+struct host_semaphore{
+	bool     recursive;
+	uint32_t count;
+};
+
+static host_task host_task_table[HOST_TASK_MAX];
+static uint8_t host_task_count = 0;
+static host_semaphore host_semaphore_table[HOST_SEMAPHORE_MAX];
+static uint8_t host_semaphore_count = 0;
+static uint32_t host_isr_nesting = 0;
+static TickType_t host_tick = 0;
+
+CoreDebug_Type host_coredebug;
+DWT_Type       host_dwt;
+uint32_t       SystemCoreClock = 480000000U;
+
+
+
+extern "C" BaseType_t xPortIsInsideInterrupt(void){
+	return (host_isr_nesting > 0)? pdTRUE : pdFALSE;
+}
+
+extern "C" void *pvPortMalloc(size_t size){
+	return malloc(size);
+}
+
+extern "C" void vPortFree(void *pv){
+	free(pv);
+}
+
+extern "C" BaseType_t xTaskCreate(TaskFunction_t pxTaskCode, const char *pcName, uint32_t usStackDepth,
+		void *pvParameters, UBaseType_t uxPriority, TaskHandle_t *pxCreatedTask){
+	(void)pxTaskCode;
+	(void)pcName;
+	(void)usStackDepth;
+	(void)uxPriority;
+
+	if(host_task_count >= HOST_TASK_MAX) return pdFAIL;
+
+	host_task *task = &host_task_table[host_task_count++];
+	task->param = pvParameters;
+	task->notify = 0;
+	if(pxCreatedTask != NULL) *pxCreatedTask = task;
+
+	return pdPASS;
+}
+
+extern "C" void vTaskNotifyGiveFromISR(TaskHandle_t xTaskToNotify, BaseType_t *pxHigherPriorityTaskWoken){
+	xTaskToNotify->notify++;
+	if(pxHigherPriorityTaskWoken != NULL) *pxHigherPriorityTaskWoken = pdTRUE;
+}
+
+/**
+ * No task body ever runs on the host, nothing to take.
+ */
+extern "C" uint32_t ulTaskNotifyTake(BaseType_t xClearCountOnExit, TickType_t xTicksToWait){
+	(void)xClearCountOnExit;
+	(void)xTicksToWait;
+
+	return 0;
+}
+
+extern "C" BaseType_t xTaskGetSchedulerState(void){
+	return taskSCHEDULER_RUNNING;
+}
+
+extern "C" TickType_t xTaskGetTickCount(void){
+	return host_tick;
+}
+
+static SemaphoreHandle_t host_semaphore_create(bool recursive, uint32_t count){
+	if(host_semaphore_count >= HOST_SEMAPHORE_MAX) return NULL;
+
+	host_semaphore *semaphore = &host_semaphore_table[host_semaphore_count++];
+	semaphore->recursive = recursive;
+	semaphore->count = count;
+
+	return semaphore;
+}
+
+extern "C" SemaphoreHandle_t xSemaphoreCreateBinary(void){
+	return host_semaphore_create(false, 0);
+}
+
+extern "C" SemaphoreHandle_t xSemaphoreCreateRecursiveMutex(void){
+	return host_semaphore_create(true, 0);
+}
+
+extern "C" BaseType_t xSemaphoreTake(SemaphoreHandle_t xSemaphore, TickType_t xBlockTime){
+	(void)xBlockTime;
+
+	if(xSemaphore->count == 0) return pdFALSE;
+	xSemaphore->count--;
+
+	return pdTRUE;
+}
+
+extern "C" BaseType_t xSemaphoreGiveFromISR(SemaphoreHandle_t xSemaphore, BaseType_t *pxHigherPriorityTaskWoken){
+	(void)pxHigherPriorityTaskWoken;
+
+	xSemaphore->count = 1;
+
+	return pdTRUE;
+}
+
+extern "C" BaseType_t xSemaphoreTakeRecursive(SemaphoreHandle_t xMutex, TickType_t xBlockTime){
+	(void)xBlockTime;
+
+	if(!xMutex->recursive || host_isr_nesting > 0){
+		printf("host: recursive take on a non mutex or from an interrupt\n");
+		abort();
+	}
+	xMutex->count++;
+
+	return pdTRUE;
+}
+
+extern "C" BaseType_t xSemaphoreGiveRecursive(SemaphoreHandle_t xMutex){
+	if(!xMutex->recursive || xMutex->count == 0){
+		printf("host: recursive give without a take\n");
+		abort();
+	}
+	xMutex->count--;
+
+	return pdTRUE;
+}
+
+extern "C" TaskHandle_t host_task_by_param(void *param){
+	for(uint8_t i=0; i<host_task_count; i++){
+		if(host_task_table[i].param == param) return &host_task_table[i];
+	}
+
+	return NULL;
+}
+
+extern "C" uint32_t host_task_notify_take(TaskHandle_t task){
+	uint32_t notify = (task != NULL)? task->notify : 0;
+
+	if(task != NULL) task->notify = 0;
+
+	return notify;
+}
+
+extern "C" void host_isr_enter(void){
+	host_isr_nesting++;
+}
+
+extern "C" void host_isr_exit(void){
+	host_isr_nesting--;
+}
+
+extern "C" uint32_t host_mutex_depth(void){
+	uint32_t depth = 0;
+
+	for(uint8_t i=0; i<host_semaphore_count; i++){
+		if(host_semaphore_table[i].recursive) depth += host_semaphore_table[i].count;
+	}
+
+	return depth;
+}
+
+extern "C" void host_tick_advance(TickType_t ticks){
+	host_tick += ticks;
+}
+
+
+
+extern "C" void HAL_GPIO_WritePin(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin, GPIO_PinState PinState){
+	(void)GPIOx;
+	(void)GPIO_Pin;
+	(void)PinState;
+}
+
+extern "C" void HAL_Delay(uint32_t Delay){
+	(void)Delay;
+}
+
+extern "C" uint32_t HAL_GetTick(void){
+	return host_tick;
+}
+
+extern "C" HAL_StatusTypeDef HAL_SPI_TransmitReceive_DMA(SPI_HandleTypeDef *hspi, uint8_t *pTxData, uint8_t *pRxData, uint16_t Size){
+	(void)hspi;
+	(void)pTxData;
+	(void)pRxData;
+	(void)Size;
+
+	return HAL_ERROR;
+}
+
+extern "C" HAL_StatusTypeDef HAL_SPI_Abort(SPI_HandleTypeDef *hspi){
+	(void)hspi;
+
+	return HAL_OK;
+}
+
+extern "C" HAL_StatusTypeDef HAL_TIM_IC_ConfigChannel(TIM_HandleTypeDef *htim, TIM_IC_InitTypeDef *sConfig, uint32_t Channel){
+	(void)htim;
+	(void)sConfig;
+	(void)Channel;
+
+	return HAL_OK;
+}
+
+extern "C" HAL_StatusTypeDef HAL_TIM_IC_Start_IT(TIM_HandleTypeDef *htim, uint32_t Channel){
+	(void)htim;
+	(void)Channel;
+
+	return HAL_OK;
+}
+
+extern "C" uint32_t HAL_TIM_ReadCapturedValue(TIM_HandleTypeDef *htim, uint32_t Channel){
+	return htim->Instance->CCR[Channel / 4];
+}
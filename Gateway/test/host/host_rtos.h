@@ -0,0 +1,39 @@
+/*
+ * host_rtos.h
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: anh
+ */
+
+#ifndef HOST_HOST_RTOS_H_
+#define HOST_HOST_RTOS_H_
+
+#include "FreeRTOS.h"
+#include "task.h"
+#include "semphr.h"
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+/**
+ * Test side controls of the host kernel stand-in.
+ * A test plays the scheduler: it takes the notifications an interrupt gave a
+ * task and runs that task's work itself.
+ */
+TaskHandle_t host_task_by_param(void *param);
+uint32_t host_task_notify_take(TaskHandle_t task);
+
+void host_isr_enter(void);
+void host_isr_exit(void);
+
+/** Depth summed over every recursive mutex, 0 when nothing is held. */
+uint32_t host_mutex_depth(void);
+
+void host_tick_advance(TickType_t ticks);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* HOST_HOST_RTOS_H_ */
@@ -0,0 +1,38 @@
+/*
+ * host_test.h
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: anh
+ */
+
+#ifndef HOST_HOST_TEST_H_
+#define HOST_HOST_TEST_H_
+
+#include "stdio.h"
+
+
+/**
+ * Minimal checks for the host tests, a failure is reported and counted, the
+ * test goes on. main() returns HOST_TEST_RESULT().
+ */
+static int host_test_failures = 0;
+
+#define HOST_CHECK(cond) do{ \
+	if(!(cond)){ \
+		printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+		host_test_failures++; \
+	} \
+} while(0)
+
+#define HOST_CHECK_EQ(actual, expected) do{ \
+	long long _a = (long long)(actual), _e = (long long)(expected); \
+	if(_a != _e){ \
+		printf("%s:%d: check failed: %s == %s (%lld != %lld)\n", __FILE__, __LINE__, #actual, #expected, _a, _e); \
+		host_test_failures++; \
+	} \
+} while(0)
+
+#define HOST_TEST_RESULT() ((host_test_failures == 0)? 0 : 1)
+
+
+#endif /* HOST_HOST_TEST_H_ */
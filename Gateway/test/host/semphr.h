@@ -0,0 +1,34 @@
+/*
+ * semphr.h
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: anh
+ */
+
+#ifndef HOST_SEMPHR_H_
+#define HOST_SEMPHR_H_
+
+#include "FreeRTOS.h"
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+typedef struct host_semaphore *SemaphoreHandle_t;
+
+/**
+ * Single thread, a take that would block fails at once. Recursive mutexes
+ * count their depth, an unbalanced give aborts the test.
+ */
+SemaphoreHandle_t xSemaphoreCreateBinary(void);
+SemaphoreHandle_t xSemaphoreCreateRecursiveMutex(void);
+BaseType_t xSemaphoreTake(SemaphoreHandle_t xSemaphore, TickType_t xBlockTime);
+BaseType_t xSemaphoreGiveFromISR(SemaphoreHandle_t xSemaphore, BaseType_t *pxHigherPriorityTaskWoken);
+BaseType_t xSemaphoreTakeRecursive(SemaphoreHandle_t xMutex, TickType_t xBlockTime);
+BaseType_t xSemaphoreGiveRecursive(SemaphoreHandle_t xMutex);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* HOST_SEMPHR_H_ */
@@ -0,0 +1,141 @@
+/*
+ * stm32h7xx_hal.h
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: anh
+ */
+
+#ifndef HOST_STM32H7XX_HAL_H_
+#define HOST_STM32H7XX_HAL_H_
+
+/**
+ * Host stand-in for the STM32H7 HAL, only what lrphys and lrmac reference.
+ * Peripherals are plain structs, GPIO and timer calls are recorded or ignored,
+ * the DMA path always fails so lrphys stays on its polled/hook path.
+ */
+#include "stdint.h"
+#include "stddef.h"
+#include "stdbool.h"
+#include "string.h"
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+#define __IO volatile
+
+#define MODIFY_REG(REG, CLEARMASK, SETMASK) ((REG) = (((REG) & (~(CLEARMASK))) | (SETMASK)))
+
+typedef enum{
+	HAL_OK = 0,
+	HAL_ERROR,
+	HAL_BUSY,
+	HAL_TIMEOUT,
+} HAL_StatusTypeDef;
+
+typedef enum{
+	GPIO_PIN_RESET = 0,
+	GPIO_PIN_SET,
+} GPIO_PinState;
+
+typedef struct{
+	__IO uint32_t BSRR;
+} GPIO_TypeDef;
+
+typedef struct{
+	__IO uint32_t CR1;
+	__IO uint32_t CR2;
+	__IO uint32_t SR;
+	__IO uint32_t IFCR;
+	__IO uint32_t TXDR;
+	__IO uint32_t RXDR;
+} SPI_TypeDef;
+
+#define SPI_CR1_SPE    (1UL << 0)
+#define SPI_CR1_CSTART (1UL << 9)
+#define SPI_CR2_TSIZE  (0xffffUL)
+#define SPI_SR_RXP     (1UL << 0)
+#define SPI_SR_TXP     (1UL << 1)
+#define SPI_SR_EOT     (1UL << 3)
+#define SPI_IFCR_EOTC  (1UL << 3)
+#define SPI_IFCR_TXTFC (1UL << 4)
+#define SPI_IFCR_OVRC  (1UL << 6)
+
+typedef struct{
+	SPI_TypeDef *Instance;
+	void        *hdmarx;
+	void        *hdmatx;
+} SPI_HandleTypeDef;
+
+typedef struct{
+	__IO uint32_t CNT;
+	__IO uint32_t CCR[4];
+} TIM_TypeDef;
+
+typedef struct{
+	TIM_TypeDef *Instance;
+	uint32_t    Channel;
+} TIM_HandleTypeDef;
+
+typedef struct{
+	uint32_t ICPolarity;
+	uint32_t ICSelection;
+	uint32_t ICPrescaler;
+	uint32_t ICFilter;
+} TIM_IC_InitTypeDef;
+
+#define TIM_CHANNEL_1            0x00000000U
+#define TIM_CHANNEL_2            0x00000004U
+#define TIM_CHANNEL_3            0x00000008U
+#define TIM_CHANNEL_4            0x0000000CU
+#define TIM_ICPOLARITY_RISING    0x00000000U
+#define TIM_ICSELECTION_DIRECTTI 0x00000001U
+#define TIM_ICPSC_DIV1           0x00000000U
+
+#define __HAL_TIM_GET_COUNTER(__HANDLE__) ((__HANDLE__)->Instance->CNT)
+
+typedef struct{
+	__IO uint32_t DEMCR;
+} CoreDebug_Type;
+
+typedef struct{
+	__IO uint32_t CTRL;
+	__IO uint32_t CYCCNT;
+} DWT_Type;
+
+#define CoreDebug_DEMCR_TRCENA_Msk (1UL << 24)
+#define DWT_CTRL_CYCCNTENA_Msk     (1UL << 0)
+
+extern CoreDebug_Type host_coredebug;
+extern DWT_Type       host_dwt;
+extern uint32_t       SystemCoreClock;
+
+#define CoreDebug (&host_coredebug)
+#define DWT       (&host_dwt)
+
+void HAL_GPIO_WritePin(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin, GPIO_PinState PinState);
+void HAL_Delay(uint32_t Delay);
+uint32_t HAL_GetTick(void);
+
+HAL_StatusTypeDef HAL_SPI_TransmitReceive_DMA(SPI_HandleTypeDef *hspi, uint8_t *pTxData, uint8_t *pRxData, uint16_t Size);
+HAL_StatusTypeDef HAL_SPI_Abort(SPI_HandleTypeDef *hspi);
+
+HAL_StatusTypeDef HAL_TIM_IC_ConfigChannel(TIM_HandleTypeDef *htim, TIM_IC_InitTypeDef *sConfig, uint32_t Channel);
+HAL_StatusTypeDef HAL_TIM_IC_Start_IT(TIM_HandleTypeDef *htim, uint32_t Channel);
+uint32_t HAL_TIM_ReadCapturedValue(TIM_HandleTypeDef *htim, uint32_t Channel);
+
+static inline void SCB_CleanDCache_by_Addr(uint32_t *addr, int32_t dsize){
+	(void)addr;
+	(void)dsize;
+}
+
+static inline void SCB_InvalidateDCache_by_Addr(uint32_t *addr, int32_t dsize){
+	(void)addr;
+	(void)dsize;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* HOST_STM32H7XX_HAL_H_ */
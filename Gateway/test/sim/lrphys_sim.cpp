@@ -0,0 +1,439 @@
+/*
+ * lrphys_sim.cpp
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: anh
+ */
+
+#include "sim/lrphys_sim.h"
+#include "lorawan/lrphys/lrphys_airtime.h"
+
+#include "string.h"
+
+
+
+#define LRPHYS_SIM_REG_VALID_HEADER_MASK 0x10
+#define LRPHYS_SIM_MODE_MASK             0x07
+#define LRPHYS_SIM_CAD_SYMBOLS           2 /** CAD listens about one symbol and processes for another */
+
+static const uint32_t lrphys_sim_bw_table[10] = {
+	7800, 10400, 15600, 20800, 31250, 41700, 62500, 125000, 250000, 500000
+};
+
+
+
+lrphys_sim::lrphys_sim(void) {
+	reset();
+}
+
+/**
+ * Power on values of the registers lrphys touches (SX1276 datasheet, 6.4).
+ */
+void lrphys_sim::reset(void) {
+	memset(_reg, 0x00, sizeof(_reg));
+	memset(_fifo, 0x00, sizeof(_fifo));
+
+	_reg[LRPHYS_REG_OP_MODE] = 0x09;
+	_reg[LRPHYS_REG_FRF_MSB] = 0x6c;
+	_reg[LRPHYS_REG_FRF_MID] = 0x80;
+	_reg[LRPHYS_REG_FRF_LSB] = 0x00;
+	_reg[LRPHYS_REG_PA_CONFIG] = 0x4f;
+	_reg[LRPHYS_REG_OCP] = 0x2b;
+	_reg[LRPHYS_REG_LNA] = 0x20;
+	_reg[LRPHYS_REG_FIFO_TX_BASE_ADDR] = 0x80;
+	_reg[LRPHYS_REG_FIFO_RX_BASE_ADDR] = 0x00;
+	_reg[LRPHYS_REG_MODEM_CONFIG_1] = 0x72;
+	_reg[LRPHYS_REG_MODEM_CONFIG_2] = 0x70;
+	_reg[LRPHYS_REG_PREAMBLE_LSB] = 0x08;
+	_reg[LRPHYS_REG_PAYLOAD_LENGTH] = 0x01;
+	_reg[LRPHYS_REG_DETECTION_OPTIMIZE] = 0xc3;
+	_reg[LRPHYS_REG_INVERTIQ] = 0x27;
+	_reg[LRPHYS_REG_DETECTION_THRESHOLD] = 0x0a;
+	_reg[LRPHYS_REG_SYNC_WORD] = 0x12;
+	_reg[LRPHYS_REG_INVERTIQ2] = 0x1d;
+	_reg[LRPHYS_REG_VERSION] = 0x12;
+	_reg[LRPHYS_REG_PA_DAC] = 0x84;
+
+	_rx_ptr = 0;
+	_air = false;
+	_tx_pending = false;
+	_rx_pending = false;
+	_cad_pending = false;
+	_tx_frame_valid = false;
+	_now = 0;
+
+	reset_stats();
+}
+
+void lrphys_sim::register_dio0_handler(lrphys_sim_dio_f handler, void *arg) {
+	_dio0_handler = handler;
+	_dio0_arg = arg;
+}
+
+void lrphys_sim::transfer(void *sim, uint8_t address, const uint8_t *txbuf,
+		uint8_t *rxbuf, uint8_t size) {
+	((lrphys_sim*) sim)->transaction(address, txbuf, rxbuf, size);
+}
+
+/**
+ * One CS-asserted SPI access: address byte then size data bytes.
+ * Register address auto increments, FIFO accesses move FIFO_ADDR_PTR instead.
+ */
+void lrphys_sim::transaction(uint8_t address, const uint8_t *txbuf,
+		uint8_t *rxbuf, uint8_t size) {
+	bool write = (address & 0x80) != 0;
+	uint8_t reg = address & 0x7f;
+
+	_stats.transactions++;
+	_stats.bytes += size;
+
+	for (uint8_t i = 0; i < size; i++) {
+		if (reg == LRPHYS_REG_FIFO) {
+			uint8_t ptr = _reg[LRPHYS_REG_FIFO_ADDR_PTR];
+
+			if (rxbuf != NULL)
+				rxbuf[i] = _fifo[ptr];
+			if (write && txbuf != NULL)
+				_fifo[ptr] = txbuf[i];
+
+			_reg[LRPHYS_REG_FIFO_ADDR_PTR] = ptr + 1;
+			_stats.fifo_bytes++;
+		} else {
+			uint8_t r = (reg + i) & 0x7f;
+
+			if (rxbuf != NULL)
+				rxbuf[i] = read_register(r);
+			if (write && txbuf != NULL)
+				write_register(r, txbuf[i]);
+		}
+	}
+
+	if (write)
+		_stats.writes++;
+	else
+		_stats.reads++;
+}
+
+bool lrphys_sim::inject_frame(const uint8_t *payload, uint8_t size,
+		int16_t rssi, int8_t snr_q4, bool crc_error, uint8_t sf,
+		int32_t freq_error) {
+	if (_air) {
+		_stats.rx_dropped++;
+		return false;
+	}
+
+	memcpy(_rx_frame, payload, size);
+	_rx_frame_size = size;
+	_rx_rssi = rssi;
+	_rx_snr = snr_q4;
+	_rx_freq_error = freq_error;
+	_rx_crc_error = crc_error;
+
+	_air = true;
+	_air_sf = (sf != 0) ? sf : modem_sf();
+	_air_start = _now;
+	_air_end = _now + time_on_air(size, _air_sf);
+
+	rx_lock();
+
+	return true;
+}
+
+bool lrphys_sim::last_tx_frame(uint8_t *payload, uint8_t *size) {
+	if (!_tx_frame_valid)
+		return false;
+
+	memcpy(payload, _tx_frame, _tx_frame_size);
+	*size = _tx_frame_size;
+
+	return true;
+}
+
+/**
+ * Current RSSI (RegRssiValue) as seen by the receiver, in dBm.
+ */
+void lrphys_sim::set_channel_rssi(int16_t rssi) {
+	_reg[LRPHYS_REG_RSSI_VALUE] = (uint8_t) (rssi + rssi_offset());
+}
+
+/**
+ * Move the virtual clock, completing TX, CAD and air events in time order.
+ */
+void lrphys_sim::advance(uint32_t us) {
+	uint32_t target = _now + us;
+
+	while (1) {
+		uint32_t at = target;
+		uint8_t event = 0;
+
+		/**
+		 * Earliest due event first, ties go TX, CAD, air.
+		 */
+		if (_tx_pending && (int32_t) (_tx_done_at - at) <= 0) {
+			at = _tx_done_at;
+			event = 1;
+		}
+		if (_cad_pending && ((int32_t) (_cad_done_at - at) < 0
+				|| (event == 0 && _cad_done_at == at))) {
+			at = _cad_done_at;
+			event = 2;
+		}
+		if (_air && ((int32_t) (_air_end - at) < 0
+				|| (event == 0 && _air_end == at))) {
+			at = _air_end;
+			event = 3;
+		}
+		if (event == 0)
+			break;
+
+		_now = at;
+		if (event == 1)
+			complete_tx();
+		else if (event == 2)
+			complete_cad();
+		else
+			complete_air();
+	}
+
+	_now = target;
+}
+
+uint32_t lrphys_sim::now(void) {
+	return _now;
+}
+
+/**
+ * Time on air with the current modem configuration, in us. sf 0 is the
+ * modem spreading factor, another one gets the LDRO the datasheet mandates.
+ */
+uint32_t lrphys_sim::time_on_air(uint8_t size, uint8_t sf) {
+	uint8_t cr = ((_reg[LRPHYS_REG_MODEM_CONFIG_1] >> 1) & 0x07) + 4;
+	bool ih = (_reg[LRPHYS_REG_MODEM_CONFIG_1] & 0x01) != 0;
+	bool crc = (_reg[LRPHYS_REG_MODEM_CONFIG_2] & 0x04) != 0;
+	bool ldro = (_reg[LRPHYS_REG_MODEM_CONFIG_3] & 0x08) != 0;
+	uint16_t preamble = ((uint16_t) _reg[LRPHYS_REG_PREAMBLE_MSB] << 8)
+			| _reg[LRPHYS_REG_PREAMBLE_LSB];
+
+	if (sf != 0 && sf != modem_sf())
+		ldro = lrphys_airtime_ldro(sf, modem_bw());
+	else
+		sf = modem_sf();
+
+	return lrphys_airtime_ldro_us(size, sf, modem_bw(), cr, preamble, crc, ih,
+			ldro);
+}
+
+uint32_t lrphys_sim::preamble_time(uint8_t sf) {
+	uint16_t preamble = ((uint16_t) _reg[LRPHYS_REG_PREAMBLE_MSB] << 8)
+			| _reg[LRPHYS_REG_PREAMBLE_LSB];
+
+	return lrphys_airtime_preamble_us((sf != 0) ? sf : modem_sf(), modem_bw(),
+			preamble);
+}
+
+uint8_t lrphys_sim::peek_register(uint8_t address) {
+	return _reg[address & 0x7f];
+}
+
+uint8_t lrphys_sim::mode(void) {
+	return _reg[LRPHYS_REG_OP_MODE] & LRPHYS_SIM_MODE_MASK;
+}
+
+void lrphys_sim::get_stats(lrphys_sim_stats_t *stats) {
+	*stats = _stats;
+}
+
+void lrphys_sim::reset_stats(void) {
+	memset(&_stats, 0, sizeof(lrphys_sim_stats_t));
+}
+
+
+
+uint8_t lrphys_sim::read_register(uint8_t address) {
+	if (address == LRPHYS_REG_MODEM_STAT)
+		return _rx_pending ? LRPHYS_MODEM_STAT_RX_ONGOING : 0x00;
+
+	return _reg[address];
+}
+
+void lrphys_sim::write_register(uint8_t address, uint8_t value) {
+	switch (address) {
+	case LRPHYS_REG_IRQ_FLAGS:
+		_reg[address] &= ~value;
+		break;
+	case LRPHYS_REG_OP_MODE:
+		set_mode(value);
+		break;
+	case LRPHYS_REG_FIFO_RX_CURRENT_ADDR:
+	case LRPHYS_REG_FIFO_RX_BYTE_ADDR:
+	case LRPHYS_REG_RX_NB_BYTES:
+	case LRPHYS_REG_MODEM_STAT:
+	case LRPHYS_REG_PKT_SNR_VALUE:
+	case LRPHYS_REG_PKT_RSSI_VALUE:
+	case LRPHYS_REG_RSSI_VALUE:
+	case LRPHYS_REG_FREQ_ERROR_MSB:
+	case LRPHYS_REG_FREQ_ERROR_MID:
+	case LRPHYS_REG_FREQ_ERROR_LSB:
+	case LRPHYS_REG_RSSI_WIDEBAND:
+	case LRPHYS_REG_VERSION:
+		break;
+	default:
+		_reg[address] = value;
+		break;
+	}
+}
+
+void lrphys_sim::set_mode(uint8_t value) {
+	uint8_t previous = mode();
+	uint8_t next = value & LRPHYS_SIM_MODE_MASK;
+
+	_reg[LRPHYS_REG_OP_MODE] = value;
+
+	if (next == previous)
+		return;
+
+	_tx_pending = false;
+	_rx_pending = false;
+	_cad_pending = false;
+
+	if (next == LRPHYS_MODE_TX) {
+		uint8_t base = _reg[LRPHYS_REG_FIFO_TX_BASE_ADDR];
+		uint8_t size = _reg[LRPHYS_REG_PAYLOAD_LENGTH];
+
+		for (uint8_t i = 0; i < size; i++)
+			_tx_frame[i] = _fifo[(uint8_t) (base + i)];
+		_tx_frame_size = size;
+
+		_tx_pending = true;
+		_tx_done_at = _now + time_on_air(size);
+	} else if (next == LRPHYS_MODE_RX_CONTINUOUS || next == LRPHYS_MODE_RX_SINGLE) {
+		if (previous != LRPHYS_MODE_RX_CONTINUOUS
+				&& previous != LRPHYS_MODE_RX_SINGLE)
+			_rx_ptr = _reg[LRPHYS_REG_FIFO_RX_BASE_ADDR];
+		rx_lock();
+	} else if (next == LRPHYS_MODE_CAD) {
+		_cad_pending = true;
+		_cad_done_at = _now + (uint32_t) (LRPHYS_SIM_CAD_SYMBOLS
+				* lrphys_airtime_symbol_ns(modem_sf(), modem_bw()) / 1000);
+		_cad_hit = _air && _air_sf == modem_sf()
+				&& (int32_t) (_now - (_air_start + preamble_time(_air_sf))) < 0;
+	}
+}
+
+/**
+ * The receiver synchronises on the frame on air when it listens on its
+ * spreading factor before the preamble is over.
+ */
+bool lrphys_sim::rx_lock(void) {
+	uint8_t m = mode();
+
+	if (!_air || _rx_pending
+			|| (m != LRPHYS_MODE_RX_CONTINUOUS && m != LRPHYS_MODE_RX_SINGLE)
+			|| _air_sf != modem_sf()
+			|| (int32_t) (_now - (_air_start + preamble_time(_air_sf))) >= 0)
+		return false;
+
+	_rx_pending = true;
+
+	return true;
+}
+
+void lrphys_sim::complete_tx(void) {
+	_tx_pending = false;
+	_tx_frame_valid = true;
+	_stats.tx_frames++;
+
+	_reg[LRPHYS_REG_OP_MODE] = (_reg[LRPHYS_REG_OP_MODE]
+			& ~LRPHYS_SIM_MODE_MASK) | LRPHYS_MODE_STDBY;
+
+	raise_irq(LRPHYS_IRQ_TX_DONE_MASK);
+}
+
+void lrphys_sim::complete_air(void) {
+	_air = false;
+
+	if (_rx_pending)
+		complete_rx();
+	else
+		_stats.rx_dropped++;
+}
+
+void lrphys_sim::complete_rx(void) {
+	/**
+	 * FREQ_ERROR = Ferr * Fxtal / 2^24 * 500 kHz / BW, 20 bit two's complement.
+	 */
+	int32_t ferr = (int32_t) (((int64_t) _rx_freq_error * 32000000 * 500000)
+			/ ((int64_t) modem_bw() << 24)) & 0xfffff;
+
+	_rx_pending = false;
+	_stats.rx_frames++;
+
+	_reg[LRPHYS_REG_FIFO_RX_CURRENT_ADDR] = _rx_ptr;
+	for (uint8_t i = 0; i < _rx_frame_size; i++)
+		_fifo[_rx_ptr++] = _rx_frame[i];
+
+	_reg[LRPHYS_REG_FIFO_RX_BYTE_ADDR] = _rx_ptr - 1;
+	_reg[LRPHYS_REG_RX_NB_BYTES] = _rx_frame_size;
+	_reg[LRPHYS_REG_PKT_SNR_VALUE] = (uint8_t) _rx_snr;
+	_reg[LRPHYS_REG_PKT_RSSI_VALUE] = (uint8_t) (_rx_rssi + rssi_offset());
+	_reg[LRPHYS_REG_FREQ_ERROR_MSB] = (uint8_t) (ferr >> 16);
+	_reg[LRPHYS_REG_FREQ_ERROR_MID] = (uint8_t) (ferr >> 8);
+	_reg[LRPHYS_REG_FREQ_ERROR_LSB] = (uint8_t) (ferr >> 0);
+
+	if (mode() == LRPHYS_MODE_RX_SINGLE)
+		_reg[LRPHYS_REG_OP_MODE] = (_reg[LRPHYS_REG_OP_MODE]
+				& ~LRPHYS_SIM_MODE_MASK) | LRPHYS_MODE_STDBY;
+
+	raise_irq(LRPHYS_SIM_REG_VALID_HEADER_MASK | LRPHYS_IRQ_RX_DONE_MASK
+			| (_rx_crc_error ? LRPHYS_IRQ_PAYLOAD_CRC_ERROR_MASK : 0));
+}
+
+void lrphys_sim::complete_cad(void) {
+	_cad_pending = false;
+	_stats.cad_done++;
+	if (_cad_hit)
+		_stats.cad_detected++;
+
+	_reg[LRPHYS_REG_OP_MODE] = (_reg[LRPHYS_REG_OP_MODE]
+			& ~LRPHYS_SIM_MODE_MASK) | LRPHYS_MODE_STDBY;
+
+	raise_irq(LRPHYS_IRQ_CAD_DONE_MASK
+			| (_cad_hit ? LRPHYS_IRQ_CAD_DETECTED_MASK : 0));
+}
+
+/**
+ * Set IRQ flags and pulse DIO0 when the mapping routes the event to it.
+ */
+void lrphys_sim::raise_irq(uint8_t mask) {
+	uint8_t dio0 = _reg[LRPHYS_REG_DIO_MAPPING_1] >> 6;
+
+	_reg[LRPHYS_REG_IRQ_FLAGS] |= mask;
+
+	if (((mask & LRPHYS_IRQ_RX_DONE_MASK) && dio0 == 0)
+			|| ((mask & LRPHYS_IRQ_TX_DONE_MASK) && dio0 == 1)
+			|| ((mask & LRPHYS_IRQ_CAD_DONE_MASK) && dio0 == 2)) {
+		_stats.dio0_events++;
+		if (_dio0_handler != NULL)
+			_dio0_handler(_dio0_arg);
+	}
+}
+
+uint8_t lrphys_sim::modem_sf(void) {
+	return _reg[LRPHYS_REG_MODEM_CONFIG_2] >> 4;
+}
+
+uint32_t lrphys_sim::modem_bw(void) {
+	uint8_t bw = _reg[LRPHYS_REG_MODEM_CONFIG_1] >> 4;
+
+	return lrphys_sim_bw_table[(bw > 9) ? 9 : bw];
+}
+
+int16_t lrphys_sim::rssi_offset(void) {
+	uint32_t frf = ((uint32_t) _reg[LRPHYS_REG_FRF_MSB] << 16)
+			| ((uint32_t) _reg[LRPHYS_REG_FRF_MID] << 8)
+			| _reg[LRPHYS_REG_FRF_LSB];
+	uint64_t freq = ((uint64_t) frf * 32000000) >> 19;
+
+	return (freq < LRPHYS_RF_MID_BAND_THRESHOLD) ?
+			LRPHYS_RSSI_OFFSET_LF_PORT : LRPHYS_RSSI_OFFSET_HF_PORT;
+}
@@ -0,0 +1,146 @@
+/*
+ * lrphys_sim.h
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: anh
+ */
+
+#ifndef TEST_SIM_LRPHYS_SIM_H_
+#define TEST_SIM_LRPHYS_SIM_H_
+
+#include "stdint.h"
+#include "stddef.h"
+
+#include "lorawan/lrphys/lrphys_macros.h"
+
+
+/**
+ * SX1276 LoRa mode behavioural model, host only.
+ * Sits behind the lrphys transfer hook (lrphys_hwconfig_t::transfer).
+ *
+ * Modelled: register file, FIFO with address pointer auto increment, TX/RX
+ * base and RX current address, IRQ flags (write 1 to clear), operating mode
+ * transitions, DIO0 mapping (RxDone/TxDone/CadDone), channel activity
+ * detection, modem status, packet RSSI/SNR, frequency error, current RSSI
+ * and frame time on air on a virtual microsecond clock.
+ *
+ * The air carries one frame at a time. It is received when the modem is in RX
+ * on its spreading factor when the frame starts, or enters RX on it while the
+ * preamble is still going. CAD detects a frame whose preamble covers the CAD
+ * start on the current spreading factor.
+ */
+
+typedef void(*lrphys_sim_dio_f)(void *arg);
+
+typedef struct{
+	uint32_t transactions; /** CS-asserted transfers */
+	uint32_t bytes;        /** Data bytes moved, address byte excluded */
+	uint32_t reads;
+	uint32_t writes;
+	uint32_t fifo_bytes;
+	uint32_t tx_frames;
+	uint32_t rx_frames;
+	uint32_t rx_dropped;   /** Frames on air the modem never received */
+	uint32_t cad_done;
+	uint32_t cad_detected;
+	uint32_t dio0_events;
+} lrphys_sim_stats_t;
+
+class lrphys_sim{
+	public:
+		lrphys_sim(void);
+
+		void reset(void);
+		void register_dio0_handler(lrphys_sim_dio_f handler = NULL, void *arg = NULL);
+
+		/**
+		 * lrphys transfer hook, one CS-asserted transaction.
+		 */
+		static void transfer(void *sim, uint8_t address, const uint8_t *txbuf, uint8_t *rxbuf, uint8_t size);
+		void transaction(uint8_t address, const uint8_t *txbuf, uint8_t *rxbuf, uint8_t size);
+
+		/**
+		 * Air side: start a frame at the current virtual time, sf 0 sends it on
+		 * the modem spreading factor. false when another frame is on air.
+		 */
+		bool inject_frame(const uint8_t *payload, uint8_t size, int16_t rssi = -60, int8_t snr_q4 = 40,
+				bool crc_error = false, uint8_t sf = 0, int32_t freq_error = 0);
+		bool last_tx_frame(uint8_t *payload, uint8_t *size);
+		void set_channel_rssi(int16_t rssi);
+
+		void advance(uint32_t us);
+		uint32_t now(void);
+		uint32_t time_on_air(uint8_t size, uint8_t sf = 0);
+		uint32_t preamble_time(uint8_t sf = 0);
+
+		uint8_t peek_register(uint8_t address);
+		uint8_t mode(void);
+
+		void get_stats(lrphys_sim_stats_t *stats);
+		void reset_stats(void);
+
+	private:
+		uint8_t read_register(uint8_t address);
+		void write_register(uint8_t address, uint8_t value);
+		void set_mode(uint8_t mode);
+		bool rx_lock(void);
+		void complete_tx(void);
+		void complete_rx(void);
+		void complete_cad(void);
+		void complete_air(void);
+		void raise_irq(uint8_t mask);
+		uint8_t modem_sf(void);
+		uint32_t modem_bw(void);
+		int16_t rssi_offset(void);
+
+		uint8_t  _reg[0x80];
+		uint8_t  _fifo[256];
+		uint8_t  _rx_ptr = 0;
+
+		uint8_t  _tx_frame[LRPHYS_MAX_PKT_LENGTH];
+		uint8_t  _tx_frame_size = 0;
+		bool     _tx_frame_valid = false;
+
+		/**
+		 * Frame on air.
+		 */
+		bool     _air = false;
+		uint8_t  _air_sf = 0;
+		uint32_t _air_start = 0;
+		uint32_t _air_end = 0;
+		uint8_t  _rx_frame[LRPHYS_MAX_PKT_LENGTH];
+		uint8_t  _rx_frame_size = 0;
+		int16_t  _rx_rssi = 0;
+		int8_t   _rx_snr = 0;
+		int32_t  _rx_freq_error = 0;
+		bool     _rx_crc_error = false;
+
+		bool     _tx_pending = false;
+		bool     _rx_pending = false;
+		bool     _cad_pending = false;
+		bool     _cad_hit = false;
+		uint32_t _tx_done_at = 0;
+		uint32_t _cad_done_at = 0;
+		uint32_t _now = 0;
+
+		lrphys_sim_dio_f _dio0_handler = NULL;
+		void 			 *_dio0_arg = NULL;
+
+		lrphys_sim_stats_t _stats;
+};
+
+/**
+ * lrphys_regio transport over the model, e.g. lrphys_regio<lrphys_sim_transport>.
+ */
+class lrphys_sim_transport{
+	public:
+		lrphys_sim *sim = NULL;
+
+		inline bool transfer(uint8_t address, const uint8_t *txbuf, uint8_t *rxbuf, uint8_t size){
+			sim->transaction(address, txbuf, rxbuf, size);
+			return true;
+		}
+};
+
+
+#endif /* TEST_SIM_LRPHYS_SIM_H_ */
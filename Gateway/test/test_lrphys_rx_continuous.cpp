@@ -0,0 +1,203 @@
+/*
+ * test_lrphys_rx_continuous.cpp
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: anh
+ */
+
+#include "lorawan/lrphys/lrphys.h"
+#include "sim/lrphys_sim.h"
+#include "host_rtos.h"
+#include "host_test.h"
+
+#include "string.h"
+
+
+/**
+ * RX continuous over the SX1276 model: back to back frames read in place from
+ * FIFO_RX_CURRENT_ADDR across the 256 byte FIFO wrap, RxDone folded into one
+ * service run counted as overrun, a payload overwritten while drained counted
+ * as such. The modem never leaves RX continuous.
+ */
+
+typedef struct{
+	lrphys   *phys;
+	uint32_t rx_done;
+	uint8_t  payload[LRPHYS_MAX_PKT_LENGTH];
+	uint8_t  length;
+	uint8_t  start;
+	/** Frame landing in the FIFO while the handler drains, 0 for none */
+	uint8_t  landing_size;
+} rx_events_t;
+
+static lrphys_sim sim;
+static lrphys phys;
+static lrphys_hwconfig_t hwconf;
+static rx_events_t events;
+
+static void fill(uint8_t *frame, uint8_t size, uint8_t seed){
+	for(uint8_t i=0; i<size; i++) frame[i] = (uint8_t)(seed + i * 7);
+}
+
+static void sim_dio0(void *arg){
+	host_isr_enter();
+	((lrphys *)arg)->IRQHandler();
+	host_isr_exit();
+}
+
+static void phys_event(void *arg, lrphys_eventid_t id, uint8_t len){
+	rx_events_t *ev = (rx_events_t *)arg;
+	if(id != LRPHYS_RECEIVE_COMPLETED) return;
+
+	ev->rx_done++;
+	ev->length = len;
+	ev->start = sim.peek_register(LRPHYS_REG_FIFO_RX_CURRENT_ADDR);
+
+	if(ev->landing_size > 0){
+		uint8_t frame[LRPHYS_MAX_PKT_LENGTH];
+
+		fill(frame, ev->landing_size, 0x33);
+		sim.inject_frame(frame, ev->landing_size);
+		sim.advance(sim.time_on_air(ev->landing_size));
+		ev->landing_size = 0;
+	}
+
+	ev->phys->receive((char *)ev->payload, len);
+}
+
+static void service(void){
+	uint32_t pending = host_task_notify_take(host_task_by_param(&phys));
+
+	if(pending > 0) phys.IRQProcess(pending);
+}
+
+/**
+ * One frame on air until RxDone, serviced or left pending.
+ */
+static void air_frame(uint8_t size, uint8_t seed, bool serviced){
+	uint8_t frame[LRPHYS_MAX_PKT_LENGTH];
+
+	fill(frame, size, seed);
+	HOST_CHECK(sim.inject_frame(frame, size));
+	sim.advance(sim.time_on_air(size));
+	if(serviced) service();
+}
+
+static bool payload_is(uint8_t size, uint8_t seed){
+	uint8_t frame[LRPHYS_MAX_PKT_LENGTH];
+
+	fill(frame, size, seed);
+
+	return events.length == size && memcmp(events.payload, frame, size) == 0;
+}
+
+static void test_setup(void){
+	lrphys_profile_t profile;
+
+	memset(&hwconf, 0, sizeof(hwconf));
+	hwconf.transfer = lrphys_sim::transfer;
+	hwconf.transfer_arg = &sim;
+	HOST_CHECK(phys.initialize(&hwconf));
+
+	events.phys = &phys;
+	phys.register_event_handler(phys_event, &events);
+	sim.register_dio0_handler(sim_dio0, &phys);
+
+	lrphys::build_profile(&profile, 923200000, 14, 7, 125E3, 5, 8, 0x34);
+	phys.apply_profile(&profile);
+	phys.set_mode_receive_it(0);
+	phys.reset_rx_stats();
+}
+
+static void test_back_to_back_wrap(void){
+	lrphys_rx_stats_t stats;
+	static const uint8_t expect_start[3] = {0, 100, 200};
+
+	/** Third frame runs from 200 over the FIFO end to 43 */
+	for(uint8_t i=0; i<3; i++){
+		air_frame(100, i, true);
+
+		HOST_CHECK_EQ(events.rx_done, i + 1);
+		HOST_CHECK_EQ(events.start, expect_start[i]);
+		HOST_CHECK(payload_is(100, i));
+		HOST_CHECK_EQ(sim.mode(), LRPHYS_MODE_RX_CONTINUOUS);
+	}
+
+	/** Several more laps of the FIFO with mixed sizes */
+	for(uint8_t i=0; i<12; i++){
+		uint8_t size = (uint8_t)(37 + i * 19);
+
+		air_frame(size, 0x40 + i, true);
+		HOST_CHECK(payload_is(size, 0x40 + i));
+	}
+
+	phys.get_rx_stats(&stats);
+	HOST_CHECK_EQ(stats.frames, 15);
+	HOST_CHECK_EQ(stats.overruns, 0);
+	HOST_CHECK_EQ(stats.overwritten, 0);
+	HOST_CHECK_EQ(stats.crc_errors, 0);
+	HOST_CHECK_EQ(host_mutex_depth(), 0);
+}
+
+static void test_coalesced_overrun(void){
+	lrphys_rx_stats_t stats;
+	uint32_t rx_before = events.rx_done;
+
+	phys.reset_rx_stats();
+
+	/** Two RxDone before the service task runs, only the last frame is read */
+	air_frame(60, 0x10, false);
+	air_frame(80, 0x20, false);
+	service();
+
+	phys.get_rx_stats(&stats);
+	HOST_CHECK_EQ(events.rx_done, rx_before + 1);
+	HOST_CHECK(payload_is(80, 0x20));
+	HOST_CHECK_EQ(stats.frames, 1);
+	HOST_CHECK_EQ(stats.overruns, 1);
+
+	/** Tracking resumes on the next frame */
+	air_frame(50, 0x30, true);
+	phys.get_rx_stats(&stats);
+	HOST_CHECK(payload_is(50, 0x30));
+	HOST_CHECK_EQ(stats.overruns, 1);
+	HOST_CHECK_EQ(sim.mode(), LRPHYS_MODE_RX_CONTINUOUS);
+}
+
+static void test_overwritten_while_draining(void){
+	lrphys_rx_stats_t stats;
+
+	phys.reset_rx_stats();
+
+	/** 200 byte frame, 100 more land behind it before it is drained */
+	events.landing_size = 100;
+	air_frame(200, 0x50, true);
+
+	phys.get_rx_stats(&stats);
+	HOST_CHECK_EQ(stats.overwritten, 1);
+	HOST_CHECK_EQ(stats.overruns, 0);
+
+	/** The landed frame is then serviced in order, no overrun */
+	service();
+	phys.get_rx_stats(&stats);
+	HOST_CHECK_EQ(stats.frames, 2);
+	HOST_CHECK_EQ(stats.overruns, 0);
+
+	/** Short frame and short follower fit the FIFO together */
+	events.landing_size = 40;
+	air_frame(60, 0x60, true);
+	service();
+	phys.get_rx_stats(&stats);
+	HOST_CHECK_EQ(stats.overwritten, 1);
+	HOST_CHECK(payload_is(40, 0x33));
+	HOST_CHECK_EQ(host_mutex_depth(), 0);
+}
+
+int main(void){
+	test_setup();
+	test_back_to_back_wrap();
+	test_coalesced_overrun();
+	test_overwritten_while_draining();
+
+	return HOST_TEST_RESULT();
+}
@@ -0,0 +1,240 @@
+/*
+ * test_lrphys_sim.cpp
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: anh
+ */
+
+#include "lorawan/lrphys/lrphys.h"
+#include "sim/lrphys_sim.h"
+#include "host_rtos.h"
+#include "host_test.h"
+
+#include "string.h"
+
+
+/**
+ * lrphys driven over the SX1276 model: register shadow and profile writes,
+ * deferred DIO0 service for TX done and RX done with the metadata snapshot,
+ * CAD scan locking on a frame, radio lock balance throughout.
+ */
+
+typedef struct{
+	lrphys           *phys;
+	uint32_t         tx_done;
+	uint32_t         rx_done;
+	uint32_t         crc_error;
+	uint8_t          payload[LRPHYS_MAX_PKT_LENGTH];
+	uint8_t          length;
+	lrphys_rx_meta_t meta;
+} phys_events_t;
+
+static lrphys_sim sim;
+static lrphys phys;
+static lrphys_hwconfig_t hwconf;
+static phys_events_t events;
+
+static void sim_dio0(void *arg){
+	host_isr_enter();
+	((lrphys *)arg)->IRQHandler();
+	host_isr_exit();
+}
+
+static void phys_event(void *arg, lrphys_eventid_t id, uint8_t len){
+	phys_events_t *ev = (phys_events_t *)arg;
+
+	switch(id){
+		case LRPHYS_TRANSMIT_COMPLETED:
+			ev->tx_done++;
+		break;
+		case LRPHYS_RECEIVE_COMPLETED:
+			ev->rx_done++;
+			ev->length = len;
+			ev->phys->get_rx_meta(&ev->meta);
+			ev->phys->receive((char *)ev->payload, len);
+		break;
+		case LRPHYS_ERROR_CRC:
+			ev->crc_error++;
+		break;
+	}
+}
+
+/**
+ * What the service task would do after the DIO0 notification.
+ */
+static void service(void){
+	uint32_t pending = host_task_notify_take(host_task_by_param(&phys));
+
+	if(pending > 0) phys.IRQProcess(pending);
+}
+
+/**
+ * Run the virtual clock in steps, servicing DIO0 as it comes.
+ */
+static void run_for(uint32_t us, uint32_t step){
+	for(uint32_t t=0; t<us; t+=step){
+		sim.advance(step);
+		service();
+	}
+}
+
+static void test_initialize(void){
+	memset(&hwconf, 0, sizeof(hwconf));
+	hwconf.transfer = lrphys_sim::transfer;
+	hwconf.transfer_arg = &sim;
+
+	HOST_CHECK(phys.initialize(&hwconf));
+	HOST_CHECK_EQ(host_mutex_depth(), 0);
+	HOST_CHECK_EQ(sim.mode(), LRPHYS_MODE_STDBY);
+	HOST_CHECK_EQ(sim.peek_register(LRPHYS_REG_MODEM_CONFIG_2) >> 4, 7);
+
+	events.phys = &phys;
+	phys.register_event_handler(phys_event, &events);
+	sim.register_dio0_handler(sim_dio0, &phys);
+}
+
+static void test_shadow_and_profile(void){
+	lrphys_profile_t profile;
+	lrphys_sim_stats_t stats;
+
+	/** Same setting again, served from the shadow */
+	sim.reset_stats();
+	phys.set_spreadingfactor(7);
+	phys.set_bandwidth(125E3);
+	sim.get_stats(&stats);
+	HOST_CHECK_EQ(stats.transactions, 0);
+
+	lrphys::build_profile(&profile, 868100000, 14, 9, 125E3, 5, 8, 0x34);
+	sim.reset_stats();
+	phys.apply_profile(&profile);
+	sim.get_stats(&stats);
+	HOST_CHECK(stats.transactions > 0);
+	HOST_CHECK(stats.transactions < LRPHYS_PROFILE_REGS);
+	HOST_CHECK_EQ(sim.peek_register(LRPHYS_REG_FRF_MSB), profile.value[0]);
+	HOST_CHECK_EQ(sim.peek_register(LRPHYS_REG_FRF_MID), profile.value[1]);
+	HOST_CHECK_EQ(sim.peek_register(LRPHYS_REG_FRF_LSB), profile.value[2]);
+	HOST_CHECK_EQ(sim.peek_register(LRPHYS_REG_MODEM_CONFIG_2) >> 4, 9);
+	HOST_CHECK_EQ(sim.peek_register(LRPHYS_REG_SYNC_WORD), 0x34);
+
+	sim.reset_stats();
+	phys.apply_profile(&profile);
+	sim.get_stats(&stats);
+	HOST_CHECK_EQ(stats.transactions, 0);
+	HOST_CHECK_EQ(host_mutex_depth(), 0);
+}
+
+static void test_receive(void){
+	uint8_t frame[32];
+
+	for(uint8_t i=0; i<sizeof(frame); i++) frame[i] = 0xa0 + i;
+	memset(&events.meta, 0, sizeof(events.meta));
+
+	phys.set_mode_receive_it(0);
+	HOST_CHECK_EQ(sim.mode(), LRPHYS_MODE_RX_CONTINUOUS);
+	HOST_CHECK(sim.inject_frame(frame, sizeof(frame), -97, -6, false, 0, 2400));
+	HOST_CHECK(phys.is_receiving());
+
+	run_for(sim.time_on_air(sizeof(frame)) + 1000, 500);
+
+	HOST_CHECK_EQ(events.rx_done, 1);
+	HOST_CHECK_EQ(events.length, sizeof(frame));
+	HOST_CHECK(memcmp(events.payload, frame, sizeof(frame)) == 0);
+	HOST_CHECK_EQ(events.meta.freq, 868100000);
+	HOST_CHECK_EQ(events.meta.sf, 9);
+	HOST_CHECK_EQ(events.meta.bw, 125);
+	HOST_CHECK_EQ(events.meta.snr, -6);
+	HOST_CHECK_EQ(events.meta.rssi, -97 + (-6 / 4));
+	HOST_CHECK(events.meta.freq_error >= 2399 && events.meta.freq_error <= 2401);
+	HOST_CHECK(!phys.is_receiving());
+	HOST_CHECK_EQ(sim.mode(), LRPHYS_MODE_RX_CONTINUOUS);
+	HOST_CHECK_EQ(host_mutex_depth(), 0);
+}
+
+static void test_crc_error(void){
+	uint8_t frame[8] = {0};
+
+	HOST_CHECK(sim.inject_frame(frame, sizeof(frame), -100, 10, true));
+	run_for(sim.time_on_air(sizeof(frame)) + 1000, 500);
+
+	HOST_CHECK_EQ(events.crc_error, 1);
+	HOST_CHECK_EQ(events.rx_done, 1);
+}
+
+static void test_transmit(void){
+	uint8_t frame[20], sent[LRPHYS_MAX_PKT_LENGTH], size = 0;
+
+	for(uint8_t i=0; i<sizeof(frame); i++) frame[i] = i * 3;
+
+	HOST_CHECK(phys.packet_begin());
+	HOST_CHECK_EQ(phys.transmit(frame, sizeof(frame)), sizeof(frame));
+	HOST_CHECK(phys.packet_end(true));
+	HOST_CHECK_EQ(sim.mode(), LRPHYS_MODE_TX);
+	HOST_CHECK_EQ(events.tx_done, 0);
+
+	run_for(sim.time_on_air(sizeof(frame)) + 1000, 500);
+
+	HOST_CHECK_EQ(events.tx_done, 1);
+	HOST_CHECK(sim.last_tx_frame(sent, &size));
+	HOST_CHECK_EQ(size, sizeof(frame));
+	HOST_CHECK(memcmp(sent, frame, sizeof(frame)) == 0);
+	HOST_CHECK_EQ(sim.mode(), LRPHYS_MODE_STDBY);
+	HOST_CHECK_EQ(host_mutex_depth(), 0);
+}
+
+static void test_cad_scan(void){
+	uint8_t frame[16];
+	lrphys_cad_stats_t cad;
+	lrphys_sim_stats_t stats;
+	uint32_t rx_before = events.rx_done;
+
+	for(uint8_t i=0; i<sizeof(frame); i++) frame[i] = 0x55 ^ i;
+
+	phys.reset_cad_stats();
+	phys.set_mode_cad_scan(7, 12);
+	HOST_CHECK(phys.is_cad_scanning());
+	HOST_CHECK_EQ(sim.mode(), LRPHYS_MODE_CAD);
+
+	/** SF10 frame, the scan reaches SF10 within its preamble */
+	HOST_CHECK(sim.inject_frame(frame, sizeof(frame), -90, 20, false, 10));
+	run_for(sim.time_on_air(sizeof(frame), 10) + 20000, 100);
+
+	phys.get_cad_stats(&cad);
+	sim.get_stats(&stats);
+	HOST_CHECK_EQ(events.rx_done, rx_before + 1);
+	HOST_CHECK_EQ(events.meta.sf, 10);
+	HOST_CHECK(memcmp(events.payload, frame, sizeof(frame)) == 0);
+	HOST_CHECK_EQ(cad.cad_detected[10 - LRPHYS_CAD_SF_MIN], 1);
+	HOST_CHECK_EQ(cad.hits[10 - LRPHYS_CAD_SF_MIN], 1);
+	HOST_CHECK_EQ(cad.cad_detected[7 - LRPHYS_CAD_SF_MIN], 0);
+	HOST_CHECK(cad.cad_done[7 - LRPHYS_CAD_SF_MIN] >= 2);
+	HOST_CHECK_EQ(stats.cad_detected, 1);
+
+	/** Scan starts over after the frame */
+	HOST_CHECK(phys.is_cad_scanning());
+	HOST_CHECK_EQ(sim.mode(), LRPHYS_MODE_CAD);
+
+	phys.idle();
+	HOST_CHECK(!phys.is_cad_scanning());
+	HOST_CHECK_EQ(host_mutex_depth(), 0);
+}
+
+static void test_channel_rssi(void){
+	phys.set_mode_receive_it(0);
+	sim.set_channel_rssi(-82);
+	HOST_CHECK_EQ(phys.rssi(), -82);
+	sim.set_channel_rssi(-120);
+	HOST_CHECK_EQ(phys.rssi(), -120);
+	phys.idle();
+}
+
+int main(void){
+	test_initialize();
+	test_shadow_and_profile();
+	test_receive();
+	test_crc_error();
+	test_transmit();
+	test_cad_scan();
+	test_channel_rssi();
+
+	return HOST_TEST_RESULT();
+}